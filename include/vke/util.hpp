@@ -1,12 +1,20 @@
 #pragma once
 
-#include "../src/debug/gpu_timer.hpp"        // IWYU pragma: export
-#include "../src/util/function_timer.hpp"    // IWYU pragma: export
-#include "../src/util/hash_map.hpp"          // IWYU pragma: export
-#include "../src/util/id_manager.hpp"        // IWYU pragma: export
-#include "../src/util/md_array.hpp"          // IWYU pragma: export
-#include "../src/util/slim_vec.hpp"          // IWYU pragma: export
-#include "../src/util/stencil_buffer.hpp"    // IWYU pragma: export
-#include "../src/util/util.hpp"              // IWYU pragma: export
-#include "../src/util/virtual_allocator.hpp" // IWYU pragma: export
-#include "../src/vkutil.hpp"                 // IWYU pragma: export
\ No newline at end of file
+#include "../src/debug/gpu_timer.hpp"          // IWYU pragma: export
+#include "../src/util/buffer_arena.hpp"        // IWYU pragma: export
+#include "../src/util/concurrent_hash_map.hpp" // IWYU pragma: export
+#include "../src/util/concurrent_id_manager.hpp" // IWYU pragma: export
+#include "../src/util/function_timer.hpp"      // IWYU pragma: export
+#include "../src/util/hash_map.hpp"            // IWYU pragma: export
+#include "../src/util/hash_map_view.hpp"       // IWYU pragma: export
+#include "../src/util/id_manager.hpp"          // IWYU pragma: export
+#include "../src/util/mapped_file.hpp"         // IWYU pragma: export
+#include "../src/util/md_array.hpp"            // IWYU pragma: export
+#include "../src/util/md_span.hpp"             // IWYU pragma: export
+#include "../src/util/slab_allocator.hpp"      // IWYU pragma: export
+#include "../src/util/slim_vec.hpp"            // IWYU pragma: export
+#include "../src/util/slot_map.hpp"            // IWYU pragma: export
+#include "../src/util/stencil_buffer.hpp"      // IWYU pragma: export
+#include "../src/util/util.hpp"                // IWYU pragma: export
+#include "../src/util/virtual_allocator.hpp"   // IWYU pragma: export
+#include "../src/vkutil.hpp"                   // IWYU pragma: export
\ No newline at end of file
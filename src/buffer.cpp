@@ -11,26 +11,57 @@
 
 namespace vke {
 
-Buffer::Buffer(VkBufferUsageFlags usage, usize buffer_size, bool host_visible) {
+Buffer::Buffer(VkBufferUsageFlags usage, usize buffer_size, bool host_visible)
+    : Buffer(usage, buffer_size, host_visible ? MemoryAccess::HostRandom : MemoryAccess::DeviceOnly) {}
+
+Buffer::Buffer(VkBufferUsageFlags usage, usize buffer_size, MemoryAccess access) {
     if (buffer_size == 0) THROW_ERROR("can't create buffers with 0 size");
 
     m_buffer_byte_size = buffer_size;
 
+    // the fallback for direct uploads is a staging copy into the buffer
+    if (access == MemoryAccess::DirectUpload) usage |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
     VkBufferCreateInfo create_info{
         .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
         .size  = buffer_size,
         .usage = usage,
     };
 
+    VmaAllocationCreateFlags flags = 0;
+    switch (access) {
+    case MemoryAccess::DeviceOnly: break;
+    case MemoryAccess::HostRandom: flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT; break;
+    case MemoryAccess::Upload:
+    case MemoryAccess::PersistentRing: flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT; break;
+    case MemoryAccess::Readback: flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT; break;
+    case MemoryAccess::DirectUpload: {
+        // without resizable bar the host visible device local heap is only a few hundred MiB, so large buffers are left to
+        // staging copies instead of crowding it out. the heap size is 0 if there is no such memory at all
+        auto heap_size = get_context()->get_device_info()->host_visible_device_local_heap_size;
+        if (buffer_size > heap_size / 8) break;
+
+        // lets vma pick device local memory without host access when the heap is full
+        flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT;
+        break;
+    }
+    }
+
     VmaAllocationCreateInfo alloc_info{
-        .flags = host_visible ? VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT : 0u,
-        .usage = VMA_MEMORY_USAGE_AUTO,
+        .flags = flags,
+        // staging and readback memory shouldn't take up the small host visible device local heap found without resizable bar
+        .usage = access == MemoryAccess::Upload || access == MemoryAccess::Readback ? VMA_MEMORY_USAGE_AUTO_PREFER_HOST : VMA_MEMORY_USAGE_AUTO,
     };
 
+    // readback is only fast from cached memory
+    if (access == MemoryAccess::Readback) alloc_info.preferredFlags = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+
     VK_CHECK(vmaCreateBuffer(get_context()->gpu_allocator(), &create_info, &alloc_info, &m_buffer, &m_allocation, nullptr));
     vmaSetAllocationName(get_context()->gpu_allocator(), m_allocation, "image");
 
-    if (host_visible) {
+    vmaGetAllocationMemoryProperties(get_context()->gpu_allocator(), m_allocation, &m_memory_properties);
+
+    if (access != MemoryAccess::DeviceOnly && (m_memory_properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
         VK_CHECK(vmaMapMemory(get_context()->gpu_allocator(), m_allocation, &m_mapped_data));
     }
 }
@@ -44,6 +75,29 @@ Buffer::~Buffer() {
     vmaDestroyBuffer(get_context()->gpu_allocator(), m_buffer, m_allocation);
 }
 
+void Buffer::flush_mapped_range(usize offset, usize size) {
+    if (m_mapped_data == nullptr || (m_memory_properties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) return;
+
+    // vma rounds the range out to nonCoherentAtomSize
+    VK_CHECK(vmaFlushAllocation(get_context()->gpu_allocator(), m_allocation, offset, size));
+}
+
+void Buffer::invalidate_mapped_range(usize offset, usize size) {
+    if (m_mapped_data == nullptr || (m_memory_properties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) return;
+
+    VK_CHECK(vmaInvalidateAllocation(get_context()->gpu_allocator(), m_allocation, offset, size));
+}
+
+void IBufferSpan::flush(usize offset, usize size) {
+    if (offset >= byte_size()) return;
+    vke_buffer()->flush_mapped_range(byte_offset() + offset, std::min(size, byte_size() - offset));
+}
+
+void IBufferSpan::invalidate(usize offset, usize size) {
+    if (offset >= byte_size()) return;
+    vke_buffer()->invalidate_mapped_range(byte_offset() + offset, std::min(size, byte_size() - offset));
+}
+
 BufferSpan IBufferSpan::subspan(usize _byte_offset, usize _byte_size) {
     return BufferSpan(vke_buffer(), byte_offset() + _byte_offset, std::min(_byte_size, byte_size() - _byte_offset));
 }
@@ -29,6 +29,15 @@ public:
 
     virtual usize bind_size()const{return byte_size();}
 
+    // the VkMemoryPropertyFlags of the memory backing the span, 0 if unknown
+    virtual VkMemoryPropertyFlags memory_properties() const { return 0; }
+
+    // makes cpu writes to the mapped span visible to the device, offset and size are relative to the span.
+    // only does anything for memory that isn't HOST_COHERENT
+    void flush(usize offset = 0, usize size = SIZE_MAX);
+    // makes device writes visible to the mapped span, call before reading back. only does anything for memory that isn't HOST_COHERENT
+    void invalidate(usize offset = 0, usize size = SIZE_MAX);
+
     VkDeviceSize device_address() const;
 
     template <typename T>
@@ -51,12 +60,35 @@ public:
 class IBuffer : public IBufferSpan {
 public:
     virtual ~IBuffer() = default;
+
+    // ranges are in bytes from the start of the buffer. IBufferSpan::flush and invalidate forward to these
+    virtual void flush_mapped_range(usize /*offset*/, usize /*size*/) {}
+    virtual void invalidate_mapped_range(usize /*offset*/, usize /*size*/) {}
 protected:
 };
 
+// how the cpu uses a buffer, picks the memory type and how it is mapped
+enum class MemoryAccess {
+    DeviceOnly, // never mapped
+    HostRandom, // mapped with cached random access, what host_visible = true gives
+    // staging memory in system ram that is only written sequentially (memcpy or filled in order), possibly write combined.
+    // reading from it or writing out of order can be very slow
+    Upload,
+    // gpu to cpu transfers. host cached memory so reads are fast, invalidate before reading
+    Readback,
+    // persistently mapped memory the gpu reads from directly, e.g. per frame uniform rings. written sequentially,
+    // device local if the device has host visible device local memory and system ram otherwise
+    PersistentRing,
+    // device local memory the cpu writes to directly if the device has host visible device local memory (resizable bar or
+    // integrated gpus) and device local memory that has to be uploaded with copies otherwise, or when the buffer is larger
+    // than an eighth of that heap. check is_host_visible, StencilBuffer::copy_data_direct handles both
+    DirectUpload,
+};
+
 class Buffer : public Resource, public IBuffer {
 public:
     Buffer(VkBufferUsageFlags usage, usize buffer_size, bool host_visible /* whether it is accessible by cpu*/);
+    Buffer(VkBufferUsageFlags usage, usize buffer_size, MemoryAccess access);
     ~Buffer();
 
     VkBuffer handle() const override { return m_buffer; }
@@ -75,8 +107,14 @@ public:
 
     std::span<u8> mapped_data_bytes() override { return mapped_data_as_span<u8>(); }
 
+    bool is_host_visible() const { return m_mapped_data != nullptr; }
+
 public: // overrides
     usize byte_size() const override { return m_buffer_byte_size; }
+    VkMemoryPropertyFlags memory_properties() const override { return m_memory_properties; }
+
+    void flush_mapped_range(usize offset, usize size) override;
+    void invalidate_mapped_range(usize offset, usize size) override;
 
 private:
     IBuffer* vke_buffer() override { return this; }
@@ -87,6 +125,7 @@ protected:
     VmaAllocation m_allocation;
     void* m_mapped_data      = nullptr;
     usize m_buffer_byte_size = 0;
+    VkMemoryPropertyFlags m_memory_properties = 0;
 };
 
 class BufferSpan : public IBufferSpan {
@@ -105,6 +144,8 @@ public:
 
     std::span<u8> mapped_data_bytes() override { return vke_buffer()->mapped_data_bytes().subspan(m_offset, m_byte_size); }
 
+    VkMemoryPropertyFlags memory_properties() const override { return m_buffer->memory_properties(); }
+
 private:
     IBuffer* m_buffer;
     usize m_offset, m_byte_size;
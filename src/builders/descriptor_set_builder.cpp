@@ -86,7 +86,8 @@ VkDescriptorSet DescriptorSetBuilder::build(DescriptorPool* pool, VkDescriptorSe
 }
 
 void DescriptorSetBuilder::write_to_set(VkDescriptorSet set, VkDescriptorSetLayout layout) {
-    std::vector<VkWriteDescriptorSet> writes;
+    // most sets have a handful of bindings, keep the writes off the heap
+    SmallVec<VkWriteDescriptorSet, 8> writes;
     writes.reserve(m_buffer_bindings.size() + m_image_bindings.size());
 
     for (auto& buffer_binding : m_buffer_bindings) {
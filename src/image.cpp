@@ -108,8 +108,9 @@ std::unique_ptr<Image> Image::buffer_to_image(CommandBuffer& cmd, IBufferSpan* b
 }
 
 std::unique_ptr<Image> Image::image_from_bytes(CommandBuffer& cmd, const std::span<const u8>& bytes, const ImageArgs& args, VkImageLayout final_layout) {
-    RCResource<Buffer> stencil = std::make_unique<Buffer>(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, bytes.size_bytes(), true);
+    RCResource<Buffer> stencil = std::make_unique<Buffer>(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, bytes.size_bytes(), MemoryAccess::Upload);
     memcpy(stencil->mapped_data_bytes().data(), bytes.data(), bytes.size_bytes());
+    stencil->flush();
 
     auto image = Image::buffer_to_image(cmd, stencil.get(), args);
     cmd.add_execution_dependency(stencil->get_reference());
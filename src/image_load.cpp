@@ -32,8 +32,9 @@ std::unique_ptr<Image> Image::load_png(CommandBuffer& cmd, const char* path, u32
     size_t buf_size = tex_width * tex_height * 4;
 
     // might leak pixels if an error is thrown
-    RCResource<Buffer> stencil = std::make_unique<Buffer>(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, buf_size, true);
+    RCResource<Buffer> stencil = std::make_unique<Buffer>(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, buf_size, MemoryAccess::Upload);
     memcpy(stencil->mapped_data<char>().data(), pixels, buf_size);
+    stencil->flush();
 
     stbi_image_free(pixels);
 
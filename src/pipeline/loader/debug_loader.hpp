@@ -4,6 +4,8 @@
 
 #include <unordered_map>
 
+#include "../../util/hash_map.hpp"
+#include "../../util/hash_util.hpp"
 #include "ipipeline_loader.hpp"
 
 namespace vke {
@@ -36,7 +38,8 @@ private:
     std::string resolve_shader_lib_path(const std::string& path);
 
 private:
-    std::unordered_map<std::string, std::shared_ptr<const PipelineDescription>> m_pipelines_descriptions;
+    // transparent so lookups by const char* don't build a std::string
+    vke::DenseHashMap<std::string, std::shared_ptr<const PipelineDescription>, vke::StringHash, std::equal_to<>> m_pipelines_descriptions;
 
     std::vector<std::string> m_pipeline_search_paths;
     std::vector<fs::path> m_shader_lib_paths;
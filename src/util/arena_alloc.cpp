@@ -1,5 +1,8 @@
 #include "arena_alloc.hpp"
 
+#include <bit>
+#include <mutex>
+#include <vector>
 
 #ifndef _WIN32
 #include <sys/mman.h>
@@ -12,49 +15,169 @@ const usize HEAP_SIZE = 1l << 32;
 
 namespace vke {
 
-ArenaAllocator::ArenaAllocator() {
+constexpr usize align_up(usize value, usize alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+namespace {
+
+constexpr usize COMMIT_CHUNK_SIZE = 1 << 20;
+// arenas that grow past this are backed by transparent huge pages where available
+constexpr usize HUGE_PAGE_THRESHOLD = 8 << 20;
+constexpr usize HUGE_PAGE_SIZE      = 2 << 20;
+// memory is decommitted in multiples of this, a multiple of the page size on every platform we run on.
+// finer than COMMIT_CHUNK_SIZE so the amount kept committed isn't rounded up to a whole chunk
+constexpr usize DECOMMIT_GRANULARITY = 64 << 10;
+// pooled regions keep this much committed so a recycled arena doesn't fault in its first pages again
+constexpr usize POOL_RETAINED_BYTES = 256 << 10;
+constexpr usize MAX_POOLED_REGIONS  = 16;
+
+u8* reserve_region() {
 #ifndef _WIN32
-    m_base = reinterpret_cast<u8*>(mmap(nullptr, HEAP_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    void* base = mmap(nullptr, HEAP_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) throw std::bad_alloc();
 #else
-    m_base = reinterpret_cast<u8*>(VirtualAlloc(nullptr, HEAP_SIZE, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+    void* base = VirtualAlloc(nullptr, HEAP_SIZE, MEM_RESERVE, PAGE_NOACCESS);
+    if (base == nullptr) throw std::bad_alloc();
+#endif
+    return reinterpret_cast<u8*>(base);
+}
 
+void release_region(u8* base) {
+#ifndef _WIN32
+    munmap(base, HEAP_SIZE);
+#else
+    VirtualFree(base, 0, MEM_RELEASE);
 #endif
-    
-    m_top  = m_base;
-    m_cap  = m_base + HEAP_SIZE;
 }
 
-ArenaAllocator::~ArenaAllocator() {
+void commit_pages(u8* begin, usize size) {
 #ifndef _WIN32
-    munmap(m_base, HEAP_SIZE);
+    if (mprotect(begin, size, PROT_READ | PROT_WRITE) != 0) throw std::bad_alloc();
 #else
-    VirtualFree(m_base, 0, MEM_RELEASE);
+    if (VirtualAlloc(begin, size, MEM_COMMIT, PAGE_READWRITE) == nullptr) throw std::bad_alloc();
 #endif
 }
 
+void decommit_pages(u8* begin, usize size) {
+#ifndef _WIN32
+    madvise(begin, size, MADV_DONTNEED);
+    mprotect(begin, size, PROT_NONE);
+#else
+    VirtualFree(begin, size, MEM_DECOMMIT);
+#endif
+}
 
-constexpr usize align_up(usize value, usize alignment) {
-    return (value + alignment - 1) & ~(alignment - 1);
+void enable_huge_pages([[maybe_unused]] u8* base) {
+#if !defined(_WIN32) && defined(MADV_HUGEPAGE)
+    u8* aligned_base = reinterpret_cast<u8*>(align_up(reinterpret_cast<usize>(base), HUGE_PAGE_SIZE));
+    madvise(aligned_base, HEAP_SIZE - (aligned_base - base), MADV_HUGEPAGE);
+#endif
+}
+
+struct ArenaRegion {
+    u8* base;
+    u8* committed;
+    bool huge_pages;
+};
+
+// reserved regions of destroyed arenas, recycled instead of being unmapped.
+// shader compilation and pipeline reflection create an arena per pipeline
+class ArenaRegionPool {
+public:
+    ArenaRegion acquire() {
+        {
+            std::lock_guard lock(m_mutex);
+            if (!m_regions.empty()) {
+                ArenaRegion region = m_regions.back();
+                m_regions.pop_back();
+                return region;
+            }
+        }
+
+        u8* base = reserve_region();
+        return ArenaRegion{.base = base, .committed = base, .huge_pages = false};
+    }
+
+    void release(ArenaRegion region) {
+        {
+            std::lock_guard lock(m_mutex);
+            if (m_regions.size() < MAX_POOLED_REGIONS) {
+                m_regions.push_back(region);
+                return;
+            }
+        }
+
+        release_region(region.base);
+    }
+
+private:
+    std::mutex m_mutex;
+    std::vector<ArenaRegion> m_regions;
+};
+
+// never destroyed so arenas with static storage can still return their regions
+ArenaRegionPool& region_pool() {
+    static ArenaRegionPool* pool = new ArenaRegionPool();
+    return *pool;
 }
 
-void* ArenaAllocator::alloc(usize size) {
-    // Check if there is enough space in the arena to accommodate the requested size
-    if (m_top + size > m_cap) {
-        // If not, you can handle the out-of-memory situation according to your requirements.
-        // For example, you can throw an exception or return nullptr.
-        // In this example, let's return nullptr.
+} // namespace
+
+ArenaAllocator::ArenaAllocator() {
+    ArenaRegion region = region_pool().acquire();
+
+    m_base       = region.base;
+    m_top        = m_base;
+    m_cap        = m_base + HEAP_SIZE;
+    m_committed  = region.committed;
+    m_huge_pages = region.huge_pages;
+}
+
+ArenaAllocator::~ArenaAllocator() {
+    m_top = m_base;
+    release_unused_memory(POOL_RETAINED_BYTES);
+
+    region_pool().release(ArenaRegion{.base = m_base, .committed = m_committed, .huge_pages = m_huge_pages});
+}
+
+void* ArenaAllocator::alloc(usize size, usize alignment) {
+    assert(std::has_single_bit(alignment));
+
+    // sizes stay multiples of the default alignment so the top is always at least 8 byte aligned
+    u8* start = reinterpret_cast<u8*>(align_up(reinterpret_cast<usize>(m_top), std::max(alignment, default_alignment)));
+    size      = align_up(size, default_alignment);
+
+    if (size > usize(m_cap - m_top) || usize(start - m_top) > usize(m_cap - m_top) - size) {
         return nullptr;
     }
 
-    size = align_up(size, 8);
+    if (start + size > m_committed) {
+        _commit(start + size);
+    }
+
+    m_top = start + size;
+    return start;
+}
 
-    // Allocate memory from the arena by moving the top pointer
-    void* allocated_memory = m_top;
-    m_top += size;
+void ArenaAllocator::_commit(u8* end) {
+    u8* new_committed = std::min(m_base + align_up(end - m_base, COMMIT_CHUNK_SIZE), m_cap);
+    commit_pages(m_committed, new_committed - m_committed);
+    m_committed = new_committed;
 
-    return allocated_memory;
+    if (!m_huge_pages && usize(m_committed - m_base) >= HUGE_PAGE_THRESHOLD) {
+        enable_huge_pages(m_base);
+        m_huge_pages = true;
+    }
 }
 
+void ArenaAllocator::release_unused_memory(usize keep_bytes) {
+    u8* keep_end = m_base + align_up(std::max(used(), keep_bytes), DECOMMIT_GRANULARITY);
+    if (keep_end >= m_committed) return;
+
+    decommit_pages(keep_end, m_committed - keep_end);
+    m_committed = keep_end;
+}
 
 const char* ArenaAllocator::create_str_copy(const char* str, usize* out_len) {
     size_t len = strlen(str);
@@ -63,10 +186,32 @@ const char* ArenaAllocator::create_str_copy(const char* str, usize* out_len) {
         *out_len = len;
     }
 
-    char* copy = alloc<char>(len);
+    // recycled arena memory isn't zeroed, so terminate the copy explicitly
+    char* copy = alloc<char>(len + 1);
     memcpy(copy, str, len);
+    copy[len] = '\0';
     return copy;
 }
-} // namespace vke
 
-// m_base = reinterpret_cast<u8*>(mmap(nullptr, HEAP_SIZE, 0, MAP_ANON, 0, 0));
+ArenaGen::ArenaGen(u32 generation_count) {
+    assert(generation_count > 0);
+
+    m_arenas           = std::make_unique<ArenaAllocator[]>(generation_count);
+    m_generation_count = generation_count;
+}
+
+void ArenaGen::begin_frame(u64 frame_id) {
+    m_current_frame      = frame_id;
+    m_current_generation = frame_id % m_generation_count;
+
+    current()->reset();
+}
+
+usize ArenaGen::high_water_mark() const {
+    usize mark = 0;
+    for (u32 i = 0; i < m_generation_count; i++) {
+        mark = std::max(mark, m_arenas[i].high_water_mark());
+    }
+    return mark;
+}
+} // namespace vke
@@ -1,8 +1,14 @@
 #pragma once
 
 #include "../common.hpp"
+#include "slim_vec.hpp"
 
+#include <algorithm>
+#include <cassert>
 #include <cstring>
+#include <memory>
+#include <memory_resource>
+#include <new>
 #include <span>
 
 namespace vke {
@@ -11,10 +17,12 @@ public:
     ArenaAllocator();
     ~ArenaAllocator();
 
-    void* alloc(usize size);
+    // returns null if the arena is out of space
+    void* alloc(usize size, usize alignment);
+    void* alloc(usize size) { return alloc(size, default_alignment); }
 
     template <typename T>
-    T* alloc(usize count = 1) { return reinterpret_cast<T*>(alloc(count * sizeof(T))); }
+    T* alloc(usize count = 1) { return reinterpret_cast<T*>(alloc(count * sizeof(T), std::max(alignof(T), default_alignment))); }
 
     template <typename T>
     std::span<T> create_copy(std::span<const T> src) {
@@ -42,13 +50,152 @@ public:
     ArenaAllocator(const ArenaAllocator&)            = delete;
     ArenaAllocator& operator=(const ArenaAllocator&) = delete;
 
+    static constexpr usize default_alignment = 8;
+
+public: // markers
+    // a marker is the number of bytes used at the time it was taken
+    usize get_marker() const { return m_top - m_base; }
+
+    // frees everything allocated after the marker was taken
+    void rollback(usize marker) {
+        assert(marker <= get_marker());
+        _update_high_water_mark();
+        m_top = m_base + marker;
+    }
+
+    // frees everything, doesn't touch the memory
+    void reset() { rollback(0); }
+
+    // returns the committed pages past max(used(), keep_bytes) to the os
+    void release_unused_memory(usize keep_bytes = 0);
+
+    usize used() const { return m_top - m_base; }
+    // peak usage since the arena was created or the high water mark was cleared
+    usize high_water_mark() const { return std::max(m_high_water_mark, used()); }
+    void clear_high_water_mark() { m_high_water_mark = used(); }
+
 private:
+    void _update_high_water_mark() { m_high_water_mark = high_water_mark(); }
+    void _commit(u8* end);
+
+private:
+    // the address space is reserved up front, pages are committed in chunks as the top passes m_committed
     u8* m_base;
     u8* m_top;
     u8* m_cap;
+    u8* m_committed;
+    usize m_high_water_mark = 0;
+    bool m_huge_pages       = false;
+};
+
+// rolls the arena back to where it was when the scope was created
+class ArenaScope {
+public:
+    ArenaScope(ArenaAllocator* arena) : m_arena(arena), m_marker(arena->get_marker()) {}
+    ~ArenaScope() { m_arena->rollback(m_marker); }
+
+    ArenaScope(const ArenaScope&)            = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+    ArenaAllocator* arena() const { return m_arena; }
+
+private:
+    ArenaAllocator* m_arena;
+    usize m_marker;
 };
 
+// a ring of arenas for per frame scratch memory. each frame allocates from the arena of its generation (frame_id % generation_count),
+// which is reset when the generation comes around again. the gpu must be done with a frame before its generation is reused
 class ArenaGen {
+public:
+    ArenaGen(u32 generation_count = 2);
+
+    // resets the arena of the frame's generation in O(1)
+    void begin_frame(u64 frame_id);
+
+    ArenaAllocator* current() { return &m_arenas[m_current_generation]; }
+    ArenaAllocator* get_arena(u32 generation) { return &m_arenas[generation]; }
+
+    void* alloc(usize size) { return current()->alloc(size); }
+    void* alloc(usize size, usize alignment) { return current()->alloc(size, alignment); }
+
+    template <typename T>
+    T* alloc(usize count = 1) { return current()->alloc<T>(count); }
+
+    u32 generation_count() const { return m_generation_count; }
+    u32 current_generation() const { return m_current_generation; }
+    u64 current_frame() const { return m_current_frame; }
+
+    // peak usage of a single frame of the generation
+    usize high_water_mark(u32 generation) const { return m_arenas[generation].high_water_mark(); }
+    // peak usage of any frame
+    usize high_water_mark() const;
+
+    ArenaGen(const ArenaGen&)            = delete;
+    ArenaGen& operator=(const ArenaGen&) = delete;
+
+private:
+    std::unique_ptr<ArenaAllocator[]> m_arenas;
+    u32 m_generation_count;
+    u32 m_current_generation = 0;
+    u64 m_current_frame      = 0;
+};
+
+// SlimVec allocator that allocates from an arena. frees are no-ops, the memory is released with the arena
+class ArenaVecAllocator {
+public:
+    ArenaVecAllocator() = default;
+    ArenaVecAllocator(ArenaAllocator* arena) : m_arena(arena) {}
+
+    void* allocate(usize byte_size, usize alignment) {
+        assert(m_arena && "ArenaVecAllocator has no arena");
+        return m_arena->alloc(byte_size, alignment);
+    }
+
+    void* reallocate(void* ptr, usize old_byte_size, usize new_byte_size, usize alignment) {
+        void* new_ptr = allocate(new_byte_size, alignment);
+        if (new_ptr && ptr) memcpy(new_ptr, ptr, std::min(old_byte_size, new_byte_size));
+        return new_ptr;
+    }
+
+    void deallocate(void* /*ptr*/, usize /*byte_size*/) {}
+
+    ArenaAllocator* arena() const { return m_arena; }
+
+private:
+    ArenaAllocator* m_arena = nullptr;
+};
+
+// lets std::pmr containers allocate from an arena. deallocation is a no-op
+class ArenaMemoryResource : public std::pmr::memory_resource {
+public:
+    ArenaMemoryResource(ArenaAllocator* arena) : m_arena(arena) {}
+
+    ArenaAllocator* arena() const { return m_arena; }
+
+private:
+    void* do_allocate(usize byte_size, usize alignment) override {
+        void* ptr = m_arena->alloc(byte_size, alignment);
+        if (ptr == nullptr) throw std::bad_alloc();
+        return ptr;
+    }
+
+    void do_deallocate(void* /*ptr*/, usize /*byte_size*/, usize /*alignment*/) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        auto* other_arena = dynamic_cast<const ArenaMemoryResource*>(&other);
+        return other_arena != nullptr && other_arena->m_arena == m_arena;
+    }
+
+private:
+    ArenaAllocator* m_arena;
 };
 
+// vector for temporary arrays that die with the arena
+template <class T>
+using ArenaVec = SlimVec<T, false, 0, ArenaVecAllocator>;
+
+template <class T, size_t MinStackSlots = 0>
+using ArenaSmallVec = SlimVec<T, true, MinStackSlots, ArenaVecAllocator>;
+
 } // namespace vke
\ No newline at end of file
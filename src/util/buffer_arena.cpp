@@ -0,0 +1,120 @@
+#include "buffer_arena.hpp"
+
+#include <algorithm>
+
+#include "../vulkan_context.hpp"
+#include "util.hpp"
+
+namespace vke {
+
+BufferArena::BufferArena(VkBufferUsageFlags usage, MemoryAccess access, u32 block_size) {
+    m_usage      = usage;
+    m_access     = access;
+    m_block_size = block_size;
+
+    // every limit is a power of two, so the largest one is a multiple of the others
+    const auto& limits = VulkanContext::get_context()->get_device_info()->properties.limits;
+    if (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) {
+        m_offset_alignment = std::max(m_offset_alignment, checked_integer_cast<u32>(limits.minStorageBufferOffsetAlignment));
+    }
+    if (usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT) {
+        m_offset_alignment = std::max(m_offset_alignment, checked_integer_cast<u32>(limits.minUniformBufferOffsetAlignment));
+    }
+    if (usage & (VK_BUFFER_USAGE_UNIFORM_TEXEL_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_TEXEL_BUFFER_BIT)) {
+        m_offset_alignment = std::max(m_offset_alignment, checked_integer_cast<u32>(limits.minTexelBufferOffsetAlignment));
+    }
+}
+
+BufferArena::~BufferArena() {
+    for (auto& block : m_blocks) {
+        if (block->allocation_count > 0) {
+            LOG_WARNING("buffer arena destroyed with %d live allocations", block->allocation_count);
+        }
+        block->allocator.reset();
+    }
+}
+
+BufferArena::Block& BufferArena::push_block(u32 min_size) {
+    u32 size = std::max(m_block_size, min_size);
+
+    m_blocks.push_back(std::make_unique<Block>(std::make_unique<vke::Buffer>(m_usage, size, m_access), size));
+    return *m_blocks.back();
+}
+
+BufferSpan BufferArena::allocate(u32 byte_size, u32 alignment) {
+    if (byte_size == 0) THROW_ERROR("can't allocate 0 bytes from a buffer arena");
+
+    alignment = std::max(alignment, m_offset_alignment);
+
+    auto try_allocate = [&](Block& block) -> std::optional<BufferSpan> {
+        auto allocation = block.allocator.allocate(byte_size, alignment);
+        if (!allocation.has_value()) return std::nullopt;
+
+        block.allocation_count++;
+        block.allocated_bytes += byte_size;
+        return block.buffer->subspan(allocation->offset, byte_size);
+    };
+
+    for (auto& block : m_blocks) {
+        if (auto span = try_allocate(*block)) return *span;
+    }
+
+    auto span = try_allocate(push_block(byte_size));
+    if (!span.has_value()) THROW_ERROR("failed to allocate %d bytes from a new buffer arena block", byte_size);
+
+    return *span;
+}
+
+void BufferArena::free(const BufferSpan& span) {
+    auto it = std::find_if(m_blocks.begin(), m_blocks.end(), [&](const auto& block) { return block->buffer.get() == span.vke_buffer(); });
+    if (it == m_blocks.end()) {
+        LOG_ERROR("buffer span wasn't allocated from this buffer arena");
+        return;
+    }
+
+    // the allocator looks allocations up by their offset
+    Block& block = **it;
+    block.allocator.free(VirtualAllocator::Allocation{
+        .offset = checked_integer_cast<u32>(span.byte_offset()),
+        .size   = checked_integer_cast<u32>(span.byte_size()),
+    });
+
+    block.allocation_count--;
+    block.allocated_bytes -= span.byte_size();
+
+    // one empty block is kept as a spare, so freeing and allocating around a block boundary doesn't create and destroy buffers
+    if (block.allocation_count != 0) return;
+
+    bool has_spare = std::any_of(m_blocks.begin(), m_blocks.end(), [&](const auto& other) { return other.get() != &block && other->allocation_count == 0; });
+    if (has_spare) m_blocks.erase(it);
+}
+
+void BufferArena::trim() {
+    std::erase_if(m_blocks, [](const auto& block) { return block->allocation_count == 0; });
+}
+
+void BufferArena::reset() {
+    if (m_blocks.size() > 1) m_blocks.erase(m_blocks.begin() + 1, m_blocks.end());
+
+    for (auto& block : m_blocks) {
+        block->allocator.reset();
+        block->allocation_count = 0;
+        block->allocated_bytes  = 0;
+    }
+}
+
+BufferArena::Statistics BufferArena::get_statistics() const {
+    Statistics stats{
+        .block_count = static_cast<u32>(m_blocks.size()),
+    };
+
+    for (const auto& block : m_blocks) {
+        stats.allocation_count += block->allocation_count;
+        stats.allocated_bytes += block->allocated_bytes;
+        stats.capacity += block->buffer->byte_size();
+    }
+
+    return stats;
+}
+
+} // namespace vke
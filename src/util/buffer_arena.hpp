@@ -0,0 +1,74 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "../buffer.hpp"
+#include "virtual_allocator.hpp"
+
+namespace vke {
+
+// sub-allocates BufferSpans out of a few large buffers, so many small objects share a VkBuffer and can be bound together
+// with different offsets instead of each one getting its own vmaCreateBuffer call.
+// offsets are aligned to the min storage, uniform and texel buffer offset alignments that apply to the usage.
+// freeing a span doesn't wait for the gpu, free it once the command buffers using it are done. not thread safe, same as VirtualAllocator
+class BufferArena {
+public:
+    struct Statistics {
+        u32 allocation_count = 0;
+        u32 block_count      = 0; // VkBuffers owned
+        u64 allocated_bytes  = 0; // requested sizes
+        u64 capacity         = 0; // bytes of the owned buffers
+    };
+
+public:
+    // 16MiB blocks by default. allocations larger than a block get a block of their own
+    BufferArena(VkBufferUsageFlags usage, MemoryAccess access = MemoryAccess::DeviceOnly, u32 block_size = 1 << 24);
+    ~BufferArena();
+
+    BufferArena(const BufferArena&)            = delete;
+    BufferArena& operator=(const BufferArena&) = delete;
+
+    BufferArena(BufferArena&&)            = default;
+    BufferArena& operator=(BufferArena&&) = default;
+
+    // alignment is raised to the offset alignment of the usage. byte_size can't be 0
+    BufferSpan allocate(u32 byte_size, u32 alignment = 1);
+
+    template <class T>
+    BufferSpan allocate_items(u32 count) { return allocate(count * sizeof(T), alignof(T)); }
+
+    // span has to be one returned by allocate, not a subspan of it. blocks that become empty are released unless
+    // there is no other empty block, which is kept as a spare
+    void free(const BufferSpan& span);
+
+    // releases every empty block, the spare included
+    void trim();
+
+    // frees every allocation, keeps the first block
+    void reset();
+
+    u32 offset_alignment() const { return m_offset_alignment; }
+    Statistics get_statistics() const;
+
+private:
+    struct Block {
+        RCResource<vke::Buffer> buffer;
+        VirtualAllocator allocator;
+        u32 allocation_count = 0;
+        u64 allocated_bytes  = 0;
+
+        Block(std::unique_ptr<vke::Buffer> _buffer, u32 size) : buffer(std::move(_buffer)), allocator(size) {}
+    };
+
+    Block& push_block(u32 min_size);
+
+private:
+    std::vector<std::unique_ptr<Block>> m_blocks;
+    VkBufferUsageFlags m_usage;
+    MemoryAccess m_access;
+    u32 m_block_size;
+    u32 m_offset_alignment = 1;
+};
+
+} // namespace vke
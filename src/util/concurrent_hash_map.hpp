@@ -0,0 +1,150 @@
+#pragma once
+
+#include <array>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+
+#include "hash_map.hpp"
+
+namespace vke {
+
+// a DenseHashMap split into shards selected by the high bits of the hash.
+// each shard has its own reader-writer lock so readers only ever wait on writers to the same shard
+template <class K, class V, class Hasher = std::hash<K>, class KeyEqual = std::equal_to<K>, size_t ShardCount = 32>
+class ConcurrentDenseHashMap {
+    static_assert(std::has_single_bit(ShardCount), "shard count must be a power of two");
+
+public:
+    using Map       = DenseHashMap<K, V, Hasher, KeyEqual>;
+    using size_type = typename Map::size_type;
+
+public:
+    ConcurrentDenseHashMap() = default;
+
+    ConcurrentDenseHashMap(const ConcurrentDenseHashMap&)            = delete;
+    ConcurrentDenseHashMap& operator=(const ConcurrentDenseHashMap&) = delete;
+
+public: // lookup
+    // returns a copy as a reference wouldn't outlive the shard lock
+    std::optional<V> find(const K& key) const {
+        size_t hash = Map::hash(key);
+        auto& shard = get_shard(hash);
+        auto lock   = std::shared_lock(shard.lock);
+        auto it     = shard.map.find_hashed(key, hash);
+        if (it == shard.map.end()) return std::nullopt;
+        return std::make_optional<V>((*it).second);
+    }
+
+    // calls f with the value under the shard's read lock, returns false if the key doesn't exist
+    bool visit(const K& key, auto&& f) const {
+        size_t hash = Map::hash(key);
+        auto& shard = get_shard(hash);
+        auto lock   = std::shared_lock(shard.lock);
+        auto it     = shard.map.find_hashed(key, hash);
+        if (it == shard.map.end()) return false;
+
+        f((*it).second);
+        return true;
+    }
+
+    bool contains(const K& key) const {
+        size_t hash = Map::hash(key);
+        auto& shard = get_shard(hash);
+        auto lock   = std::shared_lock(shard.lock);
+        return shard.map.find_hashed(key, hash) != shard.map.end();
+    }
+
+public: // modifiers
+    // returns false if the key already exists
+    bool insert(const K& key, V value) {
+        size_t hash = Map::hash(key);
+        auto& shard = get_shard(hash);
+        auto lock   = std::unique_lock(shard.lock);
+        return shard.map.insert_hashed(std::pair(key, std::move(value)), hash).second;
+    }
+
+    void insert_or_assign(const K& key, V value) {
+        auto& shard = get_shard(Map::hash(key));
+        auto lock   = std::unique_lock(shard.lock);
+        shard.map.insert_or_assign(key, std::move(value));
+    }
+
+    size_type erase(const K& key) {
+        auto& shard = get_shard(Map::hash(key));
+        auto lock   = std::unique_lock(shard.lock);
+        return shard.map.erase(key);
+    }
+
+    // returns the value of the key, creating it with factory() if it doesn't exist.
+    // factory runs at most once per key. it is called under the shard's write lock so it must not access this map
+    V get_or_insert_with(const K& key, auto&& factory) {
+        size_t hash = Map::hash(key);
+        auto& shard = get_shard(hash);
+
+        {
+            auto lock = std::shared_lock(shard.lock);
+            auto it   = shard.map.find_hashed(key, hash);
+            if (it != shard.map.end()) return (*it).second;
+        }
+
+        auto lock = std::unique_lock(shard.lock);
+
+        // another thread might have inserted it between the locks
+        auto it = shard.map.find_hashed(key, hash);
+        if (it != shard.map.end()) return (*it).second;
+
+        auto [new_it, _] = shard.map.insert_hashed(std::pair<K, V>(key, factory()), hash);
+        return (*new_it).second;
+    }
+
+    void clear() {
+        for (auto& shard : m_shards) {
+            auto lock = std::unique_lock(shard.lock);
+            shard.map.clear();
+        }
+    }
+
+public: // iteration
+    // shards are locked one at a time, entries modified concurrently may or may not be visited
+    void foreach (auto&& f) const {
+        for (auto& shard : m_shards) {
+            auto lock = std::shared_lock(shard.lock);
+            for (auto [key, value] : shard.map) {
+                f(key, value);
+            }
+        }
+    }
+
+    size_t size() const {
+        size_t total = 0;
+        for (auto& shard : m_shards) {
+            auto lock = std::shared_lock(shard.lock);
+            total += shard.map.size();
+        }
+        return total;
+    }
+
+private:
+    // aligned so the locks of neighbouring shards don't share a cache line
+    struct alignas(64) Shard {
+        mutable std::shared_mutex lock;
+        Map map;
+    };
+
+    static constexpr int shard_bits = std::countr_zero(ShardCount);
+
+    // the inner maps probe with the low bits of the hash, use the high bits for the shard
+    Shard& get_shard(size_t hash) { return m_shards[shard_index(hash)]; }
+    const Shard& get_shard(size_t hash) const { return m_shards[shard_index(hash)]; }
+
+    static size_t shard_index(size_t hash) {
+        if constexpr (shard_bits == 0) return 0;
+        else return hash >> (sizeof(size_t) * 8 - shard_bits);
+    }
+
+private:
+    std::array<Shard, ShardCount> m_shards;
+};
+
+} // namespace vke
@@ -0,0 +1,242 @@
+#include "concurrent_id_manager.hpp"
+
+#include <bit>
+#include <cassert>
+#include <stdexcept>
+
+namespace vke {
+
+namespace {
+
+u64 low_bits(u32 count) { return count >= 64 ? ~0ull : (1ull << count) - 1; }
+
+} // namespace
+
+ConcurrentIDManager::ConcurrentIDManager(u32 capacity, Policy policy) {
+    // the searches assume there is at least one word
+    if (capacity == 0) throw std::invalid_argument("ConcurrentIDManager capacity must not be 0");
+
+    m_capacity           = capacity;
+    m_policy             = policy;
+    m_word_count         = capacity / 64 + (capacity % 64 != 0);
+    m_summary_word_count = (m_word_count + 63) / 64;
+
+    m_words      = std::make_unique<std::atomic<u64>[]>(m_word_count);
+    m_full_words = std::make_unique<std::atomic<u64>[]>(m_summary_word_count);
+
+    for (u32 i = 0; i < m_word_count; i++) m_words[i].store(0, std::memory_order_relaxed);
+    for (u32 i = 0; i < m_summary_word_count; i++) m_full_words[i].store(0, std::memory_order_relaxed);
+
+    if (capacity % 64 != 0) m_words[m_word_count - 1].store(~low_bits(capacity % 64), std::memory_order_relaxed);
+}
+
+void ConcurrentIDManager::_mark_full(u32 word_index) {
+    u64 bit = 1ull << (word_index % 64);
+    m_full_words[word_index / 64].fetch_or(bit);
+
+    // a free may have cleared a bit before the word was marked, in which case it didn't see the mark to clear it.
+    // the frees clear their bit before the mark with seq_cst operations, so this load sees the bit if that happened
+    if (m_words[word_index].load() != ~0ull) m_full_words[word_index / 64].fetch_and(~bit);
+}
+
+template <class F>
+bool ConcurrentIDManager::_for_each_candidate_word(F&& f) {
+    u32 start = m_policy == Policy::NextFit ? m_next_fit_word.load(std::memory_order_relaxed) % m_word_count : 0;
+
+    // two passes for NextFit, the second one wraps around to the words before the start
+    for (u32 pass = 0; pass < 2; pass++) {
+        u32 first = pass == 0 ? start : 0;
+        u32 last  = pass == 0 ? m_word_count : start;
+
+        for (u32 s = first / 64; s * 64 < last; s++) {
+            u64 candidates = ~m_full_words[s].load(std::memory_order_relaxed);
+            if (s == first / 64) candidates &= ~low_bits(first % 64);
+
+            while (candidates != 0) {
+                u32 word_index = s * 64 + std::countr_zero(candidates);
+                if (word_index >= last) break;
+                candidates &= candidates - 1;
+
+                if (f(word_index)) {
+                    if (m_policy == Policy::NextFit) m_next_fit_word.store(word_index, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+        }
+
+        if (start == 0) break;
+    }
+
+    return false;
+}
+
+u32 ConcurrentIDManager::_take_from_word(u32 word_index, u32 max_count, u32* out) {
+    auto& word = m_words[word_index];
+    u64 old    = word.load(std::memory_order_relaxed);
+
+    u64 mask;
+    do {
+        u64 free = ~old;
+        if (free == 0) return 0;
+
+        mask = 0;
+        for (u32 i = 0; i < max_count && free != 0; i++) {
+            mask |= free & -free;
+            free &= free - 1;
+        }
+    } while (!word.compare_exchange_weak(old, old | mask, std::memory_order_acquire, std::memory_order_relaxed));
+
+    if ((old | mask) == ~0ull) _mark_full(word_index);
+
+    u32 count = 0;
+    for (u64 m = mask; m != 0; m &= m - 1) out[count++] = word_index * 64 + std::countr_zero(m);
+
+    m_allocated.fetch_add(count, std::memory_order_relaxed);
+    return count;
+}
+
+u32 ConcurrentIDManager::new_ids(std::span<u32> out) {
+    u32 count = 0;
+    if (out.empty()) return 0;
+
+    _for_each_candidate_word([&](u32 word_index) {
+        count += _take_from_word(word_index, out.size() - count, out.data() + count);
+        return count == out.size();
+    });
+
+    return count;
+}
+
+std::optional<u32> ConcurrentIDManager::try_new_id() {
+    u32 id;
+    if (new_ids(std::span(&id, 1)) == 0) return std::nullopt;
+    return id;
+}
+
+u32 ConcurrentIDManager::new_id() {
+    auto id = try_new_id();
+    if (!id.has_value()) throw std::runtime_error("id overflow");
+    return *id;
+}
+
+void ConcurrentIDManager::free_id(u32 id) {
+    assert(id < m_capacity);
+
+    u64 bit = 1ull << (id % 64);
+    [[maybe_unused]] u64 old = m_words[id / 64].fetch_and(~bit);
+    assert((old & bit) && "double free of an id");
+
+    _mark_not_full(id / 64);
+    m_allocated.fetch_sub(1, std::memory_order_relaxed);
+}
+
+std::optional<u32> ConcurrentIDManager::allocate_range(u32 count) {
+    if (count == 0 || count > m_capacity) return std::nullopt;
+
+    std::optional<u32> result;
+
+    if (count <= 64) {
+        u64 run_mask = low_bits(count);
+
+        _for_each_candidate_word([&](u32 word_index) {
+            auto& word = m_words[word_index];
+            u64 old    = word.load(std::memory_order_relaxed);
+
+            while (true) {
+                // bit i of runs is set if the count bits starting at i are free
+                u64 free = ~old, runs = free;
+                for (u32 i = 1; i < count && runs != 0; i++) runs &= free >> i;
+                if (runs == 0) return false;
+
+                u64 mask = run_mask << std::countr_zero(runs);
+                if (word.compare_exchange_weak(old, old | mask, std::memory_order_acquire, std::memory_order_relaxed)) {
+                    if ((old | mask) == ~0ull) _mark_full(word_index);
+
+                    result = word_index * 64 + std::countr_zero(runs);
+                    return true;
+                }
+            }
+        });
+    } else {
+        u32 run_words = (count + 63) / 64;
+
+        // whole words are claimed one at a time and rolled back if a later one turns out to be taken
+        for (u32 first = 0; first + run_words <= m_word_count && !result; first++) {
+            u32 claimed = 0;
+            for (; claimed < run_words; claimed++) {
+                u32 word_index = first + claimed;
+                u64 mask       = claimed + 1 == run_words ? low_bits(count - claimed * 64) : ~0ull;
+                u64 expected   = m_words[word_index].load(std::memory_order_relaxed);
+
+                if ((expected & mask) != 0) break;
+                if (!m_words[word_index].compare_exchange_strong(expected, expected | mask, std::memory_order_acquire, std::memory_order_relaxed)) break;
+
+                if ((expected | mask) == ~0ull) _mark_full(word_index);
+            }
+
+            if (claimed == run_words) {
+                result = first * 64;
+                break;
+            }
+
+            for (u32 i = 0; i < claimed; i++) {
+                u32 word_index = first + i;
+                m_words[word_index].fetch_and(~(i + 1 == run_words ? low_bits(count - i * 64) : ~0ull), std::memory_order_release);
+                _mark_not_full(word_index);
+            }
+
+            // the word that failed can't start a run either
+            first += claimed;
+        }
+    }
+
+    if (result) m_allocated.fetch_add(count, std::memory_order_relaxed);
+    return result;
+}
+
+void ConcurrentIDManager::free_range(u32 first, u32 count) {
+    assert(first + count <= m_capacity);
+
+    for (u32 id = first; id < first + count;) {
+        u32 word_index = id / 64;
+        u32 bit_count  = std::min(64 - id % 64, first + count - id);
+        u64 mask       = low_bits(bit_count) << (id % 64);
+
+        [[maybe_unused]] u64 old = m_words[word_index].fetch_and(~mask);
+        assert((old & mask) == mask && "double free of an id");
+
+        _mark_not_full(word_index);
+        id += bit_count;
+    }
+
+    m_allocated.fetch_sub(count, std::memory_order_relaxed);
+}
+
+u32 ConcurrentIDManager::Magazine::new_id() {
+    if (m_ids.empty()) {
+        u32 refill = std::max(m_size / 2, 1u);
+        auto ids   = m_ids.append_n(refill);
+        u32 count  = m_manager->new_ids(ids);
+        m_ids.resize(count);
+
+        if (count == 0) throw std::runtime_error("id overflow");
+    }
+
+    return m_ids.pop_back();
+}
+
+void ConcurrentIDManager::Magazine::free_id(u32 id) {
+    if (m_ids.size() >= m_size) {
+        // keep half so alternating allocate/free calls don't bounce to the shared bitmap
+        while (m_ids.size() > m_size / 2) m_manager->free_id(m_ids.pop_back());
+    }
+
+    m_ids.push_back(id);
+}
+
+void ConcurrentIDManager::Magazine::flush() {
+    for (u32 id : m_ids) m_manager->free_id(id);
+    m_ids.clear();
+}
+
+} // namespace vke
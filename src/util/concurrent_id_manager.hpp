@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <span>
+
+#include "../common.hpp"
+#include "slim_vec.hpp"
+
+namespace vke {
+
+// lock free id allocator for a fixed number of ids, for things like bindless descriptor indices that are handed out from worker threads.
+// ids are tracked in a bitmap of atomic words, with a second bitmap marking the words that are full so searches skip them.
+class ConcurrentIDManager {
+public:
+    enum class Policy {
+        LowestFree, // always hands out the lowest free id, keeps the used range tight
+        NextFit,    // continues from where the last search ended, less contention on the first words
+    };
+
+    // a small per-thread cache of ids. refills and returns ids in batches so most calls don't touch the shared bitmap.
+    // ids cached by a magazine aren't free for other threads, so LowestFree is only approximate while magazines are in use
+    class Magazine {
+    public:
+        Magazine(ConcurrentIDManager& manager, u32 size = 32) : m_manager(&manager), m_size(size) {}
+        ~Magazine() { flush(); }
+
+        Magazine(const Magazine&)            = delete;
+        Magazine& operator=(const Magazine&) = delete;
+
+        // throws if the manager is out of ids
+        u32 new_id();
+        void free_id(u32 id);
+
+        // returns all cached ids to the manager
+        void flush();
+
+    private:
+        ConcurrentIDManager* m_manager;
+        SlimVec<u32> m_ids;
+        u32 m_size;
+    };
+
+public:
+    // throws if capacity is 0
+    ConcurrentIDManager(u32 capacity, Policy policy = Policy::LowestFree);
+
+    ConcurrentIDManager(const ConcurrentIDManager&)            = delete;
+    ConcurrentIDManager& operator=(const ConcurrentIDManager&) = delete;
+
+    // throws if there are no free ids
+    u32 new_id();
+    std::optional<u32> try_new_id();
+    void free_id(u32 id);
+
+    // fills out with up to out.size() ids, taking several ids with a single atomic operation where possible. returns the number of ids written
+    u32 new_ids(std::span<u32> out);
+
+    // a contiguous run of ids. runs of up to 64 ids don't cross bitmap words, longer runs start at a word boundary.
+    // returns nullopt if no such run is free
+    std::optional<u32> allocate_range(u32 count);
+    void free_range(u32 first, u32 count);
+
+    bool is_allocated(u32 id) const { return (m_words[id / 64].load(std::memory_order_relaxed) >> (id % 64)) & 1; }
+
+    u32 capacity() const { return m_capacity; }
+    // exact when no other thread is allocating or freeing
+    u32 allocated_count() const { return m_allocated.load(std::memory_order_relaxed); }
+
+private:
+    template <class F>
+    bool _for_each_candidate_word(F&& f);
+
+    u32 _take_from_word(u32 word_index, u32 max_count, u32* out);
+    void _mark_full(u32 word_index);
+    void _mark_not_full(u32 word_index) { m_full_words[word_index / 64].fetch_and(~(1ull << (word_index % 64))); }
+
+private:
+    u32 m_capacity = 0, m_word_count = 0, m_summary_word_count = 0;
+    Policy m_policy;
+
+    // set bits are allocated ids. the bits past the capacity in the last word are set so they are never handed out
+    std::unique_ptr<std::atomic<u64>[]> m_words;
+    // set bits are full words. a word with free ids is never left marked, an unmarked full word only costs a wasted check
+    std::unique_ptr<std::atomic<u64>[]> m_full_words;
+
+    std::atomic<u32> m_next_fit_word = 0;
+    std::atomic<u32> m_allocated     = 0;
+};
+
+} // namespace vke
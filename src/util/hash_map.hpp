@@ -1,69 +1,215 @@
 #pragma once
 
+#include <algorithm>
+#include <bit>
 #include <cassert>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <numeric>
 #include <span>
 #include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VKE_HASH_MAP_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define VKE_HASH_MAP_NEON
+#include <arm_neon.h>
+#endif
 
 namespace vke {
 
 namespace impl {
-template <class T>
-void __custom_qsort(std::span<T> range, size_t offset, auto&& less, auto&& on_swap, int depth = 0) {
-    auto swap_in_span = [&](size_t a, size_t b) {
-        std::swap(range[a], range[b]);
-        on_swap(offset + a, offset + b);
-    };
 
-    if (range.size() == 2) {
-        if (!less(range[0], range[1])) {
-            swap_in_span(0, 1);
-        }
-        return;
-    } else if (range.size() <= 1) {
-        return;
+// control bytes of the DenseHashMap index table.
+// full slots store the low 7 bits of the hash (h2) so the high bit is only set for free slots
+constexpr uint8_t hash_ctrl_empty  = 0x80;
+constexpr uint8_t hash_ctrl_erased = 0xFE;
+
+// std::hash is the identity for integers, mix the bits so both h1 and h2 are well distributed
+constexpr inline uint64_t mix_hash(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+constexpr inline size_t hash_h1(uint64_t hash) { return static_cast<size_t>(hash >> 7); }
+constexpr inline uint8_t hash_h2(uint64_t hash) { return static_cast<uint8_t>(hash & 0x7F); }
+
+// one bit per matching slot of a ProbeGroup
+class GroupBitMask {
+public:
+#ifdef VKE_HASH_MAP_NEON
+    // neon masks have a nibble per slot
+    static constexpr int shift = 2;
+#else
+    static constexpr int shift = 0;
+#endif
+
+    explicit GroupBitMask(uint64_t bits) : m_bits(bits) {}
+
+    explicit operator bool() const { return m_bits != 0; }
+
+    uint32_t lowest() const { return static_cast<uint32_t>(std::countr_zero(m_bits)) >> shift; }
+    void clear_lowest() { m_bits &= m_bits - 1; }
+
+private:
+    uint64_t m_bits;
+};
+
+// a group of 16 control bytes which are matched at once
+class ProbeGroup {
+public:
+    static constexpr uint32_t width = 16;
+
+#if defined(VKE_HASH_MAP_SSE2)
+    explicit ProbeGroup(const uint8_t* ctrl) : m_ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl))) {}
+
+    GroupBitMask match(uint8_t h2) const {
+        return to_mask(_mm_cmpeq_epi8(m_ctrl, _mm_set1_epi8(static_cast<char>(h2))));
     }
 
-    // randomize the pivot occasionally to prevent worse case O(n^2) from happening
-    if ((range.size() > 20) || (depth == 0)) swap_in_span(0, rand() % range.size());
+    GroupBitMask match_empty() const { return match(hash_ctrl_empty); }
+    // empty or erased slots, both have the sign bit set
+    GroupBitMask match_free() const { return to_mask(m_ctrl); }
 
-    size_t begin = 1, end = range.size() - 1;
-    T& pivot = range[0];
+private:
+    static GroupBitMask to_mask(__m128i v) { return GroupBitMask(static_cast<uint32_t>(_mm_movemask_epi8(v))); }
 
-    while (begin < end) {
-        while (less(range[begin], pivot) && begin < range.size()) {
-            begin++;
-        }
+    __m128i m_ctrl;
+#elif defined(VKE_HASH_MAP_NEON)
+    explicit ProbeGroup(const uint8_t* ctrl) : m_ctrl(vld1q_u8(ctrl)) {}
 
-        while (!less(range[end], pivot) && begin < end) {
-            end--;
+    GroupBitMask match(uint8_t h2) const { return to_mask(vceqq_u8(m_ctrl, vdupq_n_u8(h2))); }
+    GroupBitMask match_empty() const { return match(hash_ctrl_empty); }
+    GroupBitMask match_free() const { return to_mask(vcltq_s8(vreinterpretq_s8_u8(m_ctrl), vdupq_n_s8(0))); }
+
+private:
+    // narrows the 0x00/0xFF lanes into a nibble per lane, keeping a single bit of each nibble
+    static GroupBitMask to_mask(uint8x16_t v) {
+        uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(v), 4);
+        return GroupBitMask(vget_lane_u64(vreinterpret_u64_u8(narrowed), 0) & 0x8888888888888888ull);
+    }
+
+    uint8x16_t m_ctrl;
+#else
+    explicit ProbeGroup(const uint8_t* ctrl) { memcpy(m_ctrl, ctrl, width); }
+
+    GroupBitMask match(uint8_t h2) const {
+        uint64_t bits = 0;
+        for (uint32_t i = 0; i < width; i++) {
+            if (m_ctrl[i] == h2) bits |= 1ull << i;
         }
+        return GroupBitMask(bits);
+    }
+
+    GroupBitMask match_empty() const { return match(hash_ctrl_empty); }
 
-        if (begin < end) {
-            swap_in_span(begin, end);
+    GroupBitMask match_free() const {
+        uint64_t bits = 0;
+        for (uint32_t i = 0; i < width; i++) {
+            if (m_ctrl[i] & 0x80) bits |= 1ull << i;
         }
+        return GroupBitMask(bits);
+    }
+
+private:
+    uint8_t m_ctrl[width];
+#endif
+};
+
+// layout of a DenseHashMap snapshot. the header is followed by the control bytes, index table, keys and values.
+// offsets are relative to the start of the snapshot and aligned to snapshot_section_alignment
+struct DenseHashMapSnapshotHeader {
+    static constexpr uint32_t magic_value     = 0x4D484B56; // "VKHM"
+    static constexpr uint32_t current_version = 1;
+
+    uint32_t magic, version;
+    uint32_t key_size, value_size;
+    uint32_t index_table_size, kv_pair_count;
+    uint64_t control_bytes_offset, index_table_offset, keys_offset, values_offset;
+    uint64_t total_size;
+};
+
+constexpr uint64_t snapshot_section_alignment = 64;
+
+// returns the indices of keys in ascending order
+template <class T>
+std::vector<uint32_t> comparison_sort_permutation(std::span<const T> keys, auto&& less) {
+    std::vector<uint32_t> permutation(keys.size());
+    std::iota(permutation.begin(), permutation.end(), 0);
+
+    std::sort(permutation.begin(), permutation.end(), [&](uint32_t a, uint32_t b) { return less(keys[a], keys[b]); });
+    return permutation;
+}
+
+template <class T>
+concept RadixSortable = (std::is_integral_v<T> && !std::is_same_v<T, bool>) || std::is_enum_v<T>;
+
+// returns the indices of keys in ascending order. LSD radix sort with 8 bit digits
+template <RadixSortable T>
+std::vector<uint32_t> radix_sort_permutation(std::span<const T> keys) {
+    using Underlying = typename std::conditional_t<std::is_enum_v<T>, std::underlying_type<T>, std::type_identity<T>>::type;
+    using U          = std::make_unsigned_t<Underlying>;
+
+    constexpr int bits = sizeof(U) * 8;
+
+    size_t n = keys.size();
+
+    std::vector<U> radix(n), radix_tmp(n);
+    std::vector<uint32_t> permutation(n), permutation_tmp(n);
+
+    for (size_t i = 0; i < n; i++) {
+        radix[i] = static_cast<U>(static_cast<Underlying>(keys[i]));
+        // flip the sign bit so negative values come first
+        if constexpr (std::is_signed_v<Underlying>) radix[i] ^= U(1) << (bits - 1);
+
+        permutation[i] = static_cast<uint32_t>(i);
     }
 
-    // elements bigger than pivot should be after end
-    // we move the pivot to middle
-    if (begin >= 2) {
-        size_t pivot_index = begin - 1;
-        swap_in_span(0, pivot_index);
+    for (int shift = 0; shift < bits; shift += 8) {
+        size_t offsets[256] = {};
+        for (size_t i = 0; i < n; i++) {
+            offsets[(radix[i] >> shift) & 0xFF]++;
+        }
+
+        // every key has the same digit, the pass wouldn't change the order
+        if (std::find(std::begin(offsets), std::end(offsets), n) != std::end(offsets)) continue;
+
+        size_t sum = 0;
+        for (size_t& offset : offsets) {
+            size_t count = offset;
+            offset       = sum;
+            sum += count;
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            size_t dst           = offsets[(radix[i] >> shift) & 0xFF]++;
+            radix_tmp[dst]       = radix[i];
+            permutation_tmp[dst] = permutation[i];
+        }
 
-        // don't include the pivot
-        __custom_qsort(range.subspan(0, pivot_index), offset, less, on_swap, depth + 1);
+        std::swap(radix, radix_tmp);
+        std::swap(permutation, permutation_tmp);
     }
 
-    __custom_qsort(range.subspan(begin), begin + offset, less, on_swap, depth + 1);
+    return permutation;
 }
 
 } // namespace impl
 
-template <class T>
-void custom_qsort(std::span<T> range, auto&& less = std::less<T>(), auto&& on_swap = [](size_t, size_t) {}) {
-    impl::__custom_qsort(range, 0, less, on_swap);
-}
+// both the hasher and key equal need to opt in to lookups with types other than the key type
+template <class Hasher, class KeyEqual>
+concept TransparentLookup = requires {
+    typename Hasher::is_transparent;
+    typename KeyEqual::is_transparent;
+};
 
 template <class K, class V, class Hasher = std::hash<K>, class KeyEqual = std::equal_to<K>>
 class DenseHashMap {
@@ -127,28 +273,98 @@ public: // modifiers
     template <class InputIt>
     void insert(InputIt b, InputIt e) { _insert_it_range(b, e, false); }
 
-    void insert_or_assign(const K& k, V&& v) { _insert(k, v, true); }
+    void insert_or_assign(const K& k, V&& v) { _insert(k, std::move(v), true, hash(k)); }
 
     size_type erase(const K& key) { return _erase(key); }
 
 #pragma mark #lookup
 public: // lookup
-    V& at(const K& key) { return _at<false>(key); }
-    const V& at(const K& key) const { return _const_at(key); }
-
-    V& operator[](const K& key) { return _at<true>(key); }
-    size_type count(const K& key) { return _contains(key) ? 1 : 0; }
-
-    iterator find(const K& key) { return _find<iterator>(key); }
-    const_iterator find(const K& key) const { return _find<const_iterator>(key); }
-
-    bool contains(const K& key) { return _contains(key); }
+    V& at(const K& key) { return _at<false>(key, hash(key)); }
+    const V& at(const K& key) const { return _const_at(key, hash(key)); }
+
+    V& operator[](const K& key) { return _at<true>(key, hash(key)); }
+    size_type count(const K& key) const { return _contains(key, hash(key)) ? 1 : 0; }
+
+    iterator find(const K& key) { return _find<iterator>(key, hash(key)); }
+    const_iterator find(const K& key) const { return _find<const_iterator>(key, hash(key)); }
+
+    bool contains(const K& key) const { return _contains(key, hash(key)); }
+
+    // heterogeneous lookup. e.g. std::string keys can be looked up with std::string_view or const char* without allocating
+    template <class KeyLike>
+        requires TransparentLookup<Hasher, KeyEqual>
+    V& at(const KeyLike& key) { return _at<false>(key, hash(key)); }
+    template <class KeyLike>
+        requires TransparentLookup<Hasher, KeyEqual>
+    const V& at(const KeyLike& key) const { return _const_at(key, hash(key)); }
+
+    template <class KeyLike>
+        requires TransparentLookup<Hasher, KeyEqual>
+    size_type count(const KeyLike& key) const { return _contains(key, hash(key)) ? 1 : 0; }
+
+    template <class KeyLike>
+        requires TransparentLookup<Hasher, KeyEqual>
+    iterator find(const KeyLike& key) { return _find<iterator>(key, hash(key)); }
+    template <class KeyLike>
+        requires TransparentLookup<Hasher, KeyEqual>
+    const_iterator find(const KeyLike& key) const { return _find<const_iterator>(key, hash(key)); }
+
+    template <class KeyLike>
+        requires TransparentLookup<Hasher, KeyEqual>
+    bool contains(const KeyLike& key) const { return _contains(key, hash(key)); }
+
+#pragma mark #hashed_lookup
+public: // lookup with precomputed hashes
+    // hashes passed to *_hashed functions and prefetch must come from this function.
+    // it lets batched lookups hash every key up front and probe later
+    static size_t hash(const K& key) { return hash_key(key); }
+    template <class KeyLike>
+        requires TransparentLookup<Hasher, KeyEqual>
+    static size_t hash(const KeyLike& key) { return hash_key(key); }
+
+    iterator find_hashed(const K& key, size_t hash) { return _find<iterator>(key, hash); }
+    const_iterator find_hashed(const K& key, size_t hash) const { return _find<const_iterator>(key, hash); }
+    template <class KeyLike>
+        requires TransparentLookup<Hasher, KeyEqual>
+    iterator find_hashed(const KeyLike& key, size_t hash) { return _find<iterator>(key, hash); }
+    template <class KeyLike>
+        requires TransparentLookup<Hasher, KeyEqual>
+    const_iterator find_hashed(const KeyLike& key, size_t hash) const { return _find<const_iterator>(key, hash); }
+
+    std::pair<iterator, bool> insert_hashed(value_type&& x, size_t hash) { return _insert(std::move(x.first), std::move(x.second), false, hash); }
+    std::pair<iterator, bool> insert_hashed(const value_type& x, size_t hash) { return _insert(x.first, V(x.second), false, hash); }
+
+    // pulls in the first probe group of the hash, issue it well before the matching find_hashed
+    void prefetch(size_t hash) const {
+        if (m_index_table_size == 0) return;
+
+        size_type base = (impl::hash_h1(hash) & (m_index_table_size / Group::width - 1)) * Group::width;
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(m_control_bytes + base);
+        __builtin_prefetch(m_index_table + base);
+#elif defined(VKE_HASH_MAP_SSE2)
+        _mm_prefetch(reinterpret_cast<const char*>(m_control_bytes + base), _MM_HINT_T0);
+        _mm_prefetch(reinterpret_cast<const char*>(m_index_table + base), _MM_HINT_T0);
+#endif
+    }
 
 #pragma mark #hash_policy
 public: // hash policy
     void rehash() { _rehash_all(); }
     void reserve(size_type n) { _reserve(n); }
 
+    size_type bucket_count() const { return m_index_table_size; }
+    float load_factor() const { return m_index_table_size == 0 ? 0.f : static_cast<float>(m_kv_pair_count) / m_index_table_size; }
+
+    float max_load_factor() const { return m_max_load_factor; }
+    // must be in (0,1). the table is rebuilt for the new load factor
+    void max_load_factor(float ml) {
+        assert(ml > 0.f && ml < 1.f);
+
+        m_max_load_factor = ml;
+        if (m_index_table_size != 0) _reserve(m_kv_pair_count);
+    }
+
 #pragma mark #observers
 public: // observers
     hasher hash_function() const { return hasher(); }
@@ -158,24 +374,82 @@ public: // observers
 public:
     // extra functions that are not defined in std::unordered_map
 
+    // number of groups probed to look up the key, for monitoring clustering
+    size_type probe_length(const K& key) const {
+        size_type length = 0;
+        find_table_index(key, hash_key(key), &length);
+        return length;
+    }
+
+    // slots left as tombstones by erase, they are reclaimed once the table reaches its max load
+    size_type erased_slot_count() const { return m_erased_slot_count; }
+
     // sorts by ascending order when comparison is defined for less
     void sort_by_key(auto&& less) {
-        size_t swap_count   = 0;
-        size_type cmp_count = 0;
+        _apply_permutation(impl::comparison_sort_permutation(std::span<const K>(m_keys, m_kv_pair_count), less));
+    }
 
-        auto less2 = [&](const auto& a, const auto& b) {
-            cmp_count++;
-            return less(a, b);
+    // sorts by ascending order of the keys, integral keys are radix sorted
+    void sort_by_key() {
+        if constexpr (impl::RadixSortable<K>) {
+            _apply_permutation(impl::radix_sort_permutation(std::span<const K>(m_keys, m_kv_pair_count)));
+        } else {
+            sort_by_key(std::less<K>());
+        }
+    }
+
+    // a flat copy of the table that DenseHashMapView answers lookups from without rebuilding it.
+    // keys are rehashed on lookup so the snapshot is only valid for the same Hasher and byte order
+    std::vector<uint8_t> create_snapshot() const
+        requires(std::is_trivially_copyable_v<K> && std::is_trivially_copyable_v<V>)
+    {
+        using Header = impl::DenseHashMapSnapshotHeader;
+
+        auto align = [](uint64_t offset) { return (offset + impl::snapshot_section_alignment - 1) & ~(impl::snapshot_section_alignment - 1); };
+
+        Header header{
+            .magic            = Header::magic_value,
+            .version          = Header::current_version,
+            .key_size         = sizeof(K),
+            .value_size       = sizeof(V),
+            .index_table_size = m_index_table_size,
+            .kv_pair_count    = m_kv_pair_count,
         };
 
-        custom_qsort(std::span(m_keys, m_kv_pair_count), less2, [&](size_t a, size_t b) {
-            std::swap(m_values[a], m_values[b]);
-            swap_count++;
-        });
+        header.control_bytes_offset = align(sizeof(Header));
+        header.index_table_offset   = align(header.control_bytes_offset + m_index_table_size);
+        header.keys_offset          = align(header.index_table_offset + uint64_t(m_index_table_size) * sizeof(size_type));
+        header.values_offset        = align(header.keys_offset + uint64_t(m_kv_pair_count) * sizeof(K));
+        header.total_size           = header.values_offset + uint64_t(m_kv_pair_count) * sizeof(V);
 
-        printf("swapped %d times\n", static_cast<int>(swap_count));
-        printf("compared %d times\n", static_cast<int>(cmp_count));
-        _rehash_all();
+        std::vector<uint8_t> snapshot(header.total_size);
+        memcpy(snapshot.data(), &header, sizeof(Header));
+
+        if (m_index_table_size != 0) {
+            memcpy(snapshot.data() + header.control_bytes_offset, m_control_bytes, m_index_table_size);
+            memcpy(snapshot.data() + header.index_table_offset, m_index_table, m_index_table_size * sizeof(size_type));
+        }
+
+        if (m_kv_pair_count != 0) {
+            memcpy(snapshot.data() + header.keys_offset, m_keys, m_kv_pair_count * sizeof(K));
+            memcpy(snapshot.data() + header.values_offset, m_values, m_kv_pair_count * sizeof(V));
+        }
+
+        return snapshot;
+    }
+
+    void save_snapshot(const char* path) const
+        requires(std::is_trivially_copyable_v<K> && std::is_trivially_copyable_v<V>)
+    {
+        auto snapshot = create_snapshot();
+
+        FILE* file = fopen(path, "wb");
+        if (file == nullptr) throw std::runtime_error("DenseHashMap: failed to open snapshot file for writing");
+
+        size_t written = fwrite(snapshot.data(), 1, snapshot.size(), file);
+        fclose(file);
+
+        if (written != snapshot.size()) throw std::runtime_error("DenseHashMap: failed to write snapshot");
     }
 
 #pragma mark #iterator_implement
@@ -260,13 +534,30 @@ public: // Iterator implement
     };
 
 private:
+    using Group = impl::ProbeGroup;
+
     static constexpr size_type empty_kv_index         = std::numeric_limits<size_type>::max();
-    static constexpr size_type erased_kv_index        = std::numeric_limits<size_type>::max() - 1;
     static constexpr size_type initial_capacity       = 7;
+    static constexpr float default_max_load_factor    = 0.875f;
     static constexpr size_type null_index_table_index = std::numeric_limits<size_type>::max();
 
-    static constexpr inline size_t hash_key(const K& k) { return Hasher()(k); }
-    static constexpr inline bool keys_equal(const K& a, const K& b) { return KeyEqual()(a, b); }
+    template <class KeyLike>
+    static constexpr inline size_t hash_key(const KeyLike& k) { return impl::mix_hash(Hasher()(k)); }
+    template <class KeyLike>
+    static constexpr inline bool keys_equal(const KeyLike& a, const K& b) { return KeyEqual()(a, b); }
+
+    // at least one slot is always left empty so every probe sequence terminates
+    size_type max_load(size_type index_table_size) const {
+        return std::clamp<size_type>(static_cast<size_type>(index_table_size * m_max_load_factor), 1, index_table_size - 1);
+    }
+
+    size_type index_table_size_for(size_type kv_capacity) const {
+        size_type table_size = Group::width;
+        while (max_load(table_size) < kv_capacity) {
+            table_size *= 2;
+        }
+        return table_size;
+    }
 
 #pragma mark #modifier_implement
 private: // modifier implement
@@ -284,28 +575,23 @@ private: // modifier implement
 
         if (!clear_index_table) return;
 
-        for (int i = 0; i < m_index_table_size; i++) {
-            m_index_table[i] = empty_kv_index;
-        }
+        _clear_index_table();
     }
 
     std::pair<iterator, bool> _insert_value_type(value_type&& x, bool allow_override) {
-        return _insert(std::move(x.first), std::move(x.second), allow_override);
+        size_t hash = hash_key(x.first);
+        return _insert(std::move(x.first), std::move(x.second), allow_override, hash);
     }
 
     std::pair<iterator, bool> _insert_value_type(const value_type& x, bool allow_override) {
-        return _insert(x.first, V(x.second), allow_override);
+        return _insert(x.first, V(x.second), allow_override, hash_key(x.first));
     }
 
-    std::pair<iterator, bool> _insert(K&& key, V&& value, bool allow_override) {
+    template <class KeyArg>
+    std::pair<iterator, bool> _insert(KeyArg&& key, V&& value, bool allow_override, size_t hash) {
         if (m_index_table_size == 0) _reserve(initial_capacity);
 
-        auto [index, key_exists] = find_table_index(key);
-
-        if (index == null_index_table_index) {
-            expand();
-            return _insert(std::forward<K>(key), std::forward<V>(value), allow_override);
-        }
+        auto [index, key_exists] = find_table_index(key, hash);
 
         if (key_exists) {
             size_type kv_index = m_index_table[index];
@@ -313,44 +599,24 @@ private: // modifier implement
 
             _values_ptr()[kv_index] = std::forward<V>(value);
             return std::pair(iterator(this, kv_index), true);
-        } else {
-            if (!can_push_to_kv_storage()) {
-                expand();
-                return _insert(std::forward<K>(key), std::forward<V>(value), allow_override);
-            }
-
-            size_type kv_index   = push_back_to_kv_storage(value_type(key, std::forward<V>(value)));
-            m_index_table[index] = kv_index;
-            return std::pair(iterator(this, kv_index), true);
         }
-    }
 
-    std::pair<iterator, bool> _insert(const K& key, V&& value, bool allow_override) {
-        if (m_index_table_size == 0) _reserve(initial_capacity);
-
-        auto [index, key_exists] = find_table_index(key);
-
-        if (index == null_index_table_index) {
+        if (!can_push_to_kv_storage()) {
             expand();
-            return _insert(key, std::forward<V>(value), allow_override);
+            return _insert(std::forward<KeyArg>(key), std::forward<V>(value), allow_override, hash);
         }
 
-        if (key_exists) {
-            size_type kv_index = m_index_table[index];
-            if (!allow_override) return std::pair(iterator(this, kv_index), false);
-
-            _values_ptr()[kv_index] = std::forward<V>(value);
-            return std::pair(iterator(this, kv_index), true);
-        } else {
-            if (!can_push_to_kv_storage()) {
-                expand();
-                return _insert(key, std::forward<V>(value), allow_override);
-            }
-
-            size_type kv_index   = push_back_to_kv_storage(value_type(key, std::forward<V>(value)));
-            m_index_table[index] = kv_index;
-            return std::pair(iterator(this, kv_index), true);
+        if (m_control_bytes[index] == impl::hash_ctrl_erased) {
+            m_erased_slot_count--;
+        } else if (m_kv_pair_count + m_erased_slot_count >= get_kv_storage_size()) {
+            // the remaining empty slots are needed to terminate probes, reclaim the erased ones instead
+            _rehash_all();
+            index = find_insertion_index(hash);
         }
+
+        size_type kv_index = push_back_to_kv_storage(value_type(std::forward<KeyArg>(key), std::forward<V>(value)));
+        set_slot(index, impl::hash_h2(hash), kv_index);
+        return std::pair(iterator(this, kv_index), true);
     }
 
     template <class InputIt>
@@ -372,28 +638,37 @@ private: // modifier implement
     }
 
     size_type _erase(const K& key) {
-        auto [index, key_exists] = find_table_index(key);
+        auto [index, key_exists] = find_table_index(key, hash_key(key));
 
-        if (index == std::numeric_limits<size_type>::max() || !key_exists) {
+        if (!key_exists) {
             return 0;
         }
 
         size_type kv_index = m_index_table[index];
         erase_kv_pair(kv_index);
-        m_index_table[index] = erased_kv_index;
+
+        // probes only continue past groups that have no empty slots and a group never regains one until a rehash.
+        // so if the group still has an empty slot no probe sequence went past it and no tombstone is needed
+        size_type group_base = index & ~(Group::width - 1);
+        if (Group(m_control_bytes + group_base).match_empty()) {
+            m_control_bytes[index] = impl::hash_ctrl_empty;
+        } else {
+            m_control_bytes[index] = impl::hash_ctrl_erased;
+            m_erased_slot_count++;
+        }
 
         return 1;
     }
 
 #pragma mark #lookup_implement
 private: // lookup implement
-    template <bool create_empty>
-    V& _at(const K& key) {
-        size_type kv_index = find_kv_index(key);
+    template <bool create_empty, class KeyLike>
+    V& _at(const KeyLike& key, size_t hash) {
+        size_type kv_index = find_kv_index(key, hash);
 
         if (kv_index == empty_kv_index) {
             if constexpr (create_empty) {
-                auto [it, b] = _insert(key, V(), false);
+                auto [it, b] = _insert(key, V(), false, hash);
                 return (*it).second;
             } else {
                 throw std::out_of_range("DenseHashMap: key doesn't exist");
@@ -403,8 +678,9 @@ private: // lookup implement
         return _values_ptr()[kv_index];
     }
 
-    const V& _const_at(const K& key) const {
-        size_type kv_index = find_kv_index(key);
+    template <class KeyLike>
+    const V& _const_at(const KeyLike& key, size_t hash) const {
+        size_type kv_index = find_kv_index(key, hash);
 
         if (kv_index == empty_kv_index) {
             throw std::out_of_range("DenseHashMap: key doesn't exist");
@@ -414,21 +690,45 @@ private: // lookup implement
     }
 
     // if It != const_iterator this function shouldn't be called as cons't
-    template <class It>
-    It _find(const K& key) const {
-        size_type kv_index = find_kv_index(key);
+    template <class It, class KeyLike>
+    It _find(const KeyLike& key, size_t hash) const {
+        size_type kv_index = find_kv_index(key, hash);
         if (kv_index == empty_kv_index) {
             return It(const_cast<DenseHashMap*>(this), m_kv_pair_count);
         }
         return It(const_cast<DenseHashMap*>(this), kv_index);
     }
 
-    bool _contains(const K& key) const {
-        return find_kv_index(key) != empty_kv_index;
+    template <class KeyLike>
+    bool _contains(const KeyLike& key, size_t hash) const {
+        return find_kv_index(key, hash) != empty_kv_index;
     }
 
 #pragma mark #extras_impl
 private: // extras
+    // moves the kv pairs into new arrays in the order of the permutation, then rebuilds the index table
+    void _apply_permutation(const std::vector<uint32_t>& permutation) {
+        assert(permutation.size() == m_kv_pair_count);
+
+        K* new_key_array   = _allocate<K>(m_kv_capacity);
+        V* new_value_array = _allocate<V>(m_kv_capacity);
+
+        for (size_type i = 0; i < m_kv_pair_count; i++) {
+            new (&new_key_array[i]) K(std::move(m_keys[permutation[i]]));
+            new (&new_value_array[i]) V(std::move(m_values[permutation[i]]));
+        }
+
+        _clear(false);
+        m_kv_pair_count = static_cast<size_type>(permutation.size());
+
+        _deallocate(m_keys, m_kv_capacity);
+        _deallocate(m_values, m_kv_capacity);
+
+        m_keys   = new_key_array;
+        m_values = new_value_array;
+
+        _rehash_all();
+    }
 #pragma mark #util
 private: // util
     void erase_kv_pair(size_type kv_index) {
@@ -437,7 +737,7 @@ private: // util
 
         size_type last_index = m_kv_pair_count - 1;
         if (kv_index != last_index) {
-            auto [t_index, occupied] = find_table_index(keys[last_index]);
+            auto [t_index, occupied] = find_table_index(keys[last_index], hash_key(keys[last_index]));
             assert(t_index < m_index_table_size && occupied);
 
             keys[kv_index]   = std::move(keys[last_index]);
@@ -452,7 +752,7 @@ private: // util
         m_kv_pair_count--;
     }
 
-    size_type get_kv_storage_size() const { return m_index_table_size / 2; }
+    size_type get_kv_storage_size() const { return m_kv_capacity; }
     // if it fails returns size_type::max
     size_type push_back_to_kv_storage(value_type&& x) {
         assert(can_push_to_kv_storage());
@@ -470,81 +770,102 @@ private: // util
 
         _deallocate(m_index_table, m_index_table_size);
         m_index_table = nullptr;
+        _deallocate(m_control_bytes, m_index_table_size);
+        m_control_bytes = nullptr;
         _deallocate(m_keys, get_kv_storage_size());
         m_keys = nullptr;
         _deallocate(m_values, get_kv_storage_size());
         m_values = nullptr;
 
-        m_kv_pair_count    = 0;
-        m_index_table_size = 0;
+        m_kv_pair_count     = 0;
+        m_kv_capacity       = 0;
+        m_index_table_size  = 0;
+        m_erased_slot_count = 0;
     }
 
     void hint_capacity(size_type s) {
-        size_type initial_size = get_kv_storage_size();
-        size_type desired_size = initial_size;
-
-        while (s > desired_size) {
-            desired_size = desired_size * 2 + 1;
-        }
-
-        if (initial_size != desired_size) {
-            _reserve(desired_size);
+        if (s > get_kv_storage_size()) {
+            _reserve(s);
         }
     }
     void expand() { _reserve(get_kv_storage_size() * 2 + 1); }
 
+    void set_slot(size_type index, uint8_t h2, size_type kv_index) {
+        m_control_bytes[index] = h2;
+        m_index_table[index]   = kv_index;
+    }
+
     // returns the index and whether it is occupied or not
-    std::pair<size_type, bool> find_table_index(const K& key, bool find_insertion_point = false) const {
+    // if the key doesn't exist the returned index is the first free slot on its probe sequence
+    template <class KeyLike>
+    std::pair<size_type, bool> find_table_index(const KeyLike& key, size_t hash, size_type* out_probe_length = nullptr) const {
         if (m_index_table_size == 0) return std::pair(null_index_table_index, false);
 
-        size_t hash = hash_key(key);
+        uint8_t h2 = impl::hash_h2(hash);
 
         // max index means that it doesn't have a value
         size_type insertable_index = null_index_table_index;
 
-        size_type start = hash % m_index_table_size;
-        size_type index = start;
-
-        // probe as much as the index table
-        for (size_type i = 0; i < m_index_table_size; i++, index = (start + i) % m_index_table_size) {
+        size_type group_mask = m_index_table_size / Group::width - 1;
+        size_type group      = impl::hash_h1(hash) & group_mask;
 
-            // index of its key & value
-            size_type kv_index = m_index_table[index];
+        // triangular probing over groups, as the group count is a power of two every group is visited once
+        for (size_type i = 1; i <= group_mask + 1; group = (group + i) & group_mask, i++) {
+            size_type base = group * Group::width;
+            Group g(m_control_bytes + base);
 
-            if (kv_index == empty_kv_index) {
+            if (out_probe_length) *out_probe_length = i;
 
-                if (find_insertion_point && insertable_index != null_index_table_index) {
-                    return std::pair(insertable_index, false);
-                } else {
-                    return std::pair(index, false);
+            for (auto match = g.match(h2); match; match.clear_lowest()) {
+                size_type index = base + match.lowest();
+                if (keys_equal(key, _keys_ptr()[m_index_table[index]])) {
+                    return std::pair(index, true);
                 }
-            } else if (kv_index == erased_kv_index) {
-                if (find_insertion_point) insertable_index = index;
-            } else if (keys_equal(key, _keys_ptr()[kv_index])) {
-                return std::pair(index, true);
             }
+
+            if (insertable_index == null_index_table_index) {
+                if (auto free = g.match_free()) insertable_index = base + free.lowest();
+            }
+
+            // a group with an empty slot was never full, so the key can't be further along
+            if (g.match_empty()) break;
         }
 
-        return std::pair(null_index_table_index, false);
+        return std::pair(insertable_index, false);
     }
 
-    size_type find_kv_index(const K& key) const {
-        auto [table_index, occupied] = find_table_index(key, false);
-        if (!occupied) return empty_kv_index;
+    // first free slot on the probe sequence of the hash. used when the key is known to be absent
+    size_type find_insertion_index(size_t hash) const {
+        size_type group_mask = m_index_table_size / Group::width - 1;
+        size_type group      = impl::hash_h1(hash) & group_mask;
 
-        if (table_index == null_index_table_index) return empty_kv_index;
+        for (size_type i = 1;; group = (group + i) & group_mask, i++) {
+            size_type base = group * Group::width;
 
-        size_type kv_index = m_index_table[table_index];
-        if (kv_index >= erased_kv_index) kv_index = empty_kv_index;
+            if (auto free = Group(m_control_bytes + base).match_free()) {
+                return base + free.lowest();
+            }
+        }
+    }
+
+    template <class KeyLike>
+    size_type find_kv_index(const KeyLike& key, size_t hash) const {
+        auto [table_index, occupied] = find_table_index(key, hash);
+        if (!occupied) return empty_kv_index;
 
-        return kv_index;
+        return m_index_table[table_index];
+    }
+
+    void _clear_index_table() {
+        memset(m_control_bytes, impl::hash_ctrl_empty, m_index_table_size);
+        m_erased_slot_count = 0;
     }
 
     void _reserve(size_type new_kv_capacity) {
         assert(new_kv_capacity >= m_kv_pair_count);
 
-        _deallocate(m_index_table, m_index_table_size);
-        m_index_table = nullptr;
+        size_type new_index_table_size = index_table_size_for(new_kv_capacity);
+        new_kv_capacity                = max_load(new_index_table_size);
 
         K* old_key_array   = _keys_ptr();
         V* old_value_array = _values_ptr();
@@ -562,29 +883,30 @@ private: // util
 
         _deallocate(old_key_array, get_kv_storage_size());
         _deallocate(old_value_array, get_kv_storage_size());
+        _deallocate(m_index_table, m_index_table_size);
+        _deallocate(m_control_bytes, m_index_table_size);
 
-        m_keys   = new_key_array;
-        m_values = new_value_array;
+        m_keys        = new_key_array;
+        m_values      = new_value_array;
+        m_kv_capacity = new_kv_capacity;
 
-        m_index_table_size = new_kv_capacity * 2;
+        m_index_table_size = new_index_table_size;
         m_index_table      = _allocate<size_type>(m_index_table_size);
+        m_control_bytes    = _allocate<uint8_t>(m_index_table_size);
 
         _rehash_all();
     }
 
     void _rehash_all() {
-        for (int i = 0; i < m_index_table_size; i++) {
-            m_index_table[i] = empty_kv_index;
-        }
+        if (m_index_table_size == 0) return;
 
-        K* keys = _keys_ptr();
+        _clear_index_table();
 
-        for (int i = 0; i < m_kv_pair_count; i++) {
-            auto [index, key_exists] = find_table_index(keys[i], true);
-
-            if (index == empty_kv_index) throw std::runtime_error("failed to rehash table!");
+        K* keys = _keys_ptr();
 
-            m_index_table[index] = i;
+        for (size_type i = 0; i < m_kv_pair_count; i++) {
+            size_t hash = hash_key(keys[i]);
+            set_slot(find_insertion_index(hash), impl::hash_h2(hash), i);
         }
     }
 
@@ -596,17 +918,24 @@ private: // util
             cleanup();
         }
 
-        this->m_index_table_size = other.m_index_table_size;
-        this->m_kv_pair_count    = other.m_kv_pair_count;
-        this->m_index_table      = other.m_index_table;
-        this->m_values           = other.m_values;
-        this->m_keys             = other.m_keys;
-
-        other.m_index_table_size = 0;
-        other.m_kv_pair_count    = 0;
-        other.m_index_table      = nullptr;
-        other.m_values           = nullptr;
-        other.m_keys             = nullptr;
+        this->m_index_table_size  = other.m_index_table_size;
+        this->m_kv_pair_count     = other.m_kv_pair_count;
+        this->m_erased_slot_count = other.m_erased_slot_count;
+        this->m_kv_capacity       = other.m_kv_capacity;
+        this->m_max_load_factor   = other.m_max_load_factor;
+        this->m_index_table       = other.m_index_table;
+        this->m_control_bytes     = other.m_control_bytes;
+        this->m_values            = other.m_values;
+        this->m_keys              = other.m_keys;
+
+        other.m_index_table_size  = 0;
+        other.m_kv_pair_count     = 0;
+        other.m_erased_slot_count = 0;
+        other.m_kv_capacity       = 0;
+        other.m_index_table       = nullptr;
+        other.m_control_bytes     = nullptr;
+        other.m_values            = nullptr;
+        other.m_keys              = nullptr;
     }
 
 #pragma mark #allocator
@@ -623,17 +952,24 @@ private: // allocator
     template <class T>
     T* _allocate(size_t n) { return _get_allocator2<T>().allocate(n); }
     template <class T>
-    void _deallocate(T* ptr, size_t n) { _get_allocator2<T>().deallocate(ptr, n); }
+    void _deallocate(T* ptr, size_t n) {
+        if (ptr) _get_allocator2<T>().deallocate(ptr, n);
+    }
 
 private:
     V* _values_ptr() const { return m_values; }
     K* _keys_ptr() const { return m_keys; }
 
 private:
+    // the index table is split into groups of Group::width slots.
+    // m_control_bytes holds the state of each slot and m_index_table the kv index of full slots
     size_type* m_index_table     = nullptr;
+    uint8_t* m_control_bytes     = nullptr;
     K* m_keys                    = nullptr;
     V* m_values                  = nullptr;
-    size_type m_index_table_size = 0, m_kv_pair_count = 0;
+    size_type m_index_table_size = 0, m_kv_pair_count = 0, m_erased_slot_count = 0;
+    size_type m_kv_capacity      = 0;
+    float m_max_load_factor      = default_max_load_factor;
 };
 
 } // namespace vke
\ No newline at end of file
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "hash_map.hpp"
+#include "mapped_file.hpp"
+
+namespace vke {
+
+// read-only DenseHashMap over a snapshot made by DenseHashMap::create_snapshot.
+// lookups probe the snapshot in place so nothing is deserialized or rehashed up front
+template <class K, class V, class Hasher = std::hash<K>, class KeyEqual = std::equal_to<K>>
+class DenseHashMapView {
+    static_assert(std::is_trivially_copyable_v<K> && std::is_trivially_copyable_v<V>, "snapshots require trivially copyable keys and values");
+
+public:
+    using size_type = uint32_t;
+    using Map       = DenseHashMap<K, V, Hasher, KeyEqual>;
+
+public:
+    DenseHashMapView() = default;
+
+    // the snapshot memory has to outlive the view
+    explicit DenseHashMapView(std::span<const uint8_t> snapshot) { _load(snapshot); }
+
+    // maps the snapshot file. pages are only read once a lookup touches them
+    explicit DenseHashMapView(const char* path) : m_file(path) { _load(m_file.bytes()); }
+
+public:
+    const V* find(const K& key) const {
+        if (m_index_table_size == 0) return nullptr;
+
+        size_t hash = Map::hash(key);
+        uint8_t h2  = impl::hash_h2(hash);
+
+        size_type group_mask = m_index_table_size / Group::width - 1;
+        size_type group      = impl::hash_h1(hash) & group_mask;
+
+        for (size_type i = 1; i <= group_mask + 1; group = (group + i) & group_mask, i++) {
+            size_type base = group * Group::width;
+            Group g(m_control_bytes + base);
+
+            for (auto match = g.match(h2); match; match.clear_lowest()) {
+                size_type kv_index = m_index_table[base + match.lowest()];
+                // checked here rather than when loading, so opening a snapshot doesn't read the whole index table
+                if (kv_index >= m_kv_pair_count) throw std::runtime_error("DenseHashMapView: corrupted snapshot index table");
+                if (KeyEqual()(key, m_keys[kv_index])) return &m_values[kv_index];
+            }
+
+            if (g.match_empty()) break;
+        }
+
+        return nullptr;
+    }
+
+    const V& at(const K& key) const {
+        const V* value = find(key);
+        if (value == nullptr) throw std::out_of_range("DenseHashMapView: key doesn't exist");
+        return *value;
+    }
+
+    bool contains(const K& key) const { return find(key) != nullptr; }
+
+    size_type size() const { return m_kv_pair_count; }
+    bool empty() const { return m_kv_pair_count == 0; }
+
+    std::span<const K> keys() const { return std::span<const K>(m_keys, m_kv_pair_count); }
+    std::span<const V> values() const { return std::span<const V>(m_values, m_kv_pair_count); }
+
+private:
+    using Group  = impl::ProbeGroup;
+    using Header = impl::DenseHashMapSnapshotHeader;
+
+    void _load(std::span<const uint8_t> snapshot) {
+        if (snapshot.size() < sizeof(Header)) throw std::runtime_error("DenseHashMapView: snapshot is too small");
+
+        Header header;
+        memcpy(&header, snapshot.data(), sizeof(Header));
+
+        if (header.magic != Header::magic_value) throw std::runtime_error("DenseHashMapView: not a DenseHashMap snapshot");
+        if (header.version != Header::current_version) throw std::runtime_error("DenseHashMapView: unsupported snapshot version");
+        if (header.key_size != sizeof(K) || header.value_size != sizeof(V)) throw std::runtime_error("DenseHashMapView: key or value size mismatch");
+
+        bool valid_table_size = header.index_table_size == 0 || (std::has_single_bit(header.index_table_size) && header.index_table_size >= Group::width);
+        if (!valid_table_size || header.kv_pair_count > header.index_table_size) throw std::runtime_error("DenseHashMapView: corrupted snapshot header");
+
+        auto section = [&](uint64_t offset, uint64_t byte_size, size_t alignment) {
+            if (offset > snapshot.size() || byte_size > snapshot.size() - offset) throw std::runtime_error("DenseHashMapView: snapshot is truncated");
+
+            const uint8_t* ptr = snapshot.data() + offset;
+            if (reinterpret_cast<uintptr_t>(ptr) % alignment != 0) throw std::runtime_error("DenseHashMapView: misaligned snapshot section");
+            return ptr;
+        };
+
+        m_control_bytes = section(header.control_bytes_offset, header.index_table_size, 1);
+        m_index_table   = reinterpret_cast<const size_type*>(section(header.index_table_offset, uint64_t(header.index_table_size) * sizeof(size_type), alignof(size_type)));
+        m_keys          = reinterpret_cast<const K*>(section(header.keys_offset, uint64_t(header.kv_pair_count) * sizeof(K), alignof(K)));
+        m_values        = reinterpret_cast<const V*>(section(header.values_offset, uint64_t(header.kv_pair_count) * sizeof(V), alignof(V)));
+
+        m_index_table_size = header.index_table_size;
+        m_kv_pair_count    = header.kv_pair_count;
+    }
+
+private:
+    MappedFile m_file;
+
+    const uint8_t* m_control_bytes = nullptr;
+    const size_type* m_index_table = nullptr;
+    const K* m_keys                = nullptr;
+    const V* m_values              = nullptr;
+    size_type m_index_table_size = 0, m_kv_pair_count = 0;
+};
+
+} // namespace vke
@@ -1,15 +1,40 @@
 #pragma once
 
+#include <cstdint>
 #include <functional>
+#include <string_view>
+
+namespace vke {
+
+// order dependent and mixed, so pairs of pointers or small integers (which std::hash passes through unchanged) still spread over all bits
+constexpr inline size_t hash_combine(size_t seed, size_t value) {
+    uint64_t h = seed + 0x9e3779b97f4a7c15ull + value * 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return static_cast<size_t>(h);
+}
+
+} // namespace vke
 
 namespace std {
     template <typename T1, typename T2>
     struct hash<std::pair<T1, T2>> {
         size_t operator()(const std::pair<T1, T2>& p) const {
-            auto h1 = std::hash<T1>{}(p.first);
-            auto h2 = std::hash<T2>{}(p.second);
-            // Combine the two hash values
-            return h1 ^ (h2 << 1); // Shift the second hash and XOR it with the first
+            return vke::hash_combine(std::hash<T1>{}(p.first), std::hash<T2>{}(p.second));
         }
     };
 }
+
+namespace vke {
+
+// transparent hasher for std::string keys, pair it with std::equal_to<> to look up by std::string_view or const char*
+struct StringHash {
+    using is_transparent = void;
+
+    size_t operator()(std::string_view str) const { return std::hash<std::string_view>{}(str); }
+};
+
+} // namespace vke
\ No newline at end of file
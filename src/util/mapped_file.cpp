@@ -0,0 +1,102 @@
+#include "mapped_file.hpp"
+
+#include "util.hpp"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <Windows.h>
+#endif
+
+namespace vke {
+
+MappedFile::MappedFile(const char* path) {
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) THROW_ERROR("failed to open file %s", path);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        THROW_ERROR("failed to stat file %s", path);
+    }
+
+    m_size = static_cast<usize>(st.st_size);
+
+    if (m_size > 0) {
+        void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            THROW_ERROR("failed to map file %s", path);
+        }
+        m_data = data;
+    }
+
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+#else
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) THROW_ERROR("failed to open file %s", path);
+
+    m_file_handle = file;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        _unmap();
+        THROW_ERROR("failed to stat file %s", path);
+    }
+    m_size = static_cast<usize>(size.QuadPart);
+
+    if (m_size > 0) {
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr) {
+            _unmap();
+            THROW_ERROR("failed to map file %s", path);
+        }
+        m_mapping_handle = mapping;
+
+        void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (data == nullptr) {
+            _unmap();
+            THROW_ERROR("failed to map file %s", path);
+        }
+        m_data = data;
+    }
+#endif
+}
+
+MappedFile::~MappedFile() {
+    _unmap();
+}
+
+void MappedFile::_unmap() {
+#ifndef _WIN32
+    if (m_data) munmap(m_data, m_size);
+#else
+    if (m_data) UnmapViewOfFile(m_data);
+    if (m_mapping_handle) CloseHandle(m_mapping_handle);
+    if (m_file_handle) CloseHandle(m_file_handle);
+#endif
+
+    m_data           = nullptr;
+    m_size           = 0;
+    m_file_handle    = nullptr;
+    m_mapping_handle = nullptr;
+}
+
+void MappedFile::_move_from(MappedFile& other) {
+    m_data           = other.m_data;
+    m_size           = other.m_size;
+    m_file_handle    = other.m_file_handle;
+    m_mapping_handle = other.m_mapping_handle;
+
+    other.m_data           = nullptr;
+    other.m_size           = 0;
+    other.m_file_handle    = nullptr;
+    other.m_mapping_handle = nullptr;
+}
+
+} // namespace vke
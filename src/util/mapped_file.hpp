@@ -0,0 +1,43 @@
+#pragma once
+
+#include "../common.hpp"
+
+#include <span>
+
+namespace vke {
+
+// read-only memory mapping of a whole file. pages are loaded lazily on first access
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const char* path);
+    ~MappedFile();
+
+    MappedFile(MappedFile&& other) { _move_from(other); }
+    MappedFile& operator=(MappedFile&& other) {
+        if (this != &other) {
+            _unmap();
+            _move_from(other);
+        }
+        return *this;
+    }
+
+    MappedFile(const MappedFile&)            = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::span<const u8> bytes() const { return std::span<const u8>(reinterpret_cast<const u8*>(m_data), m_size); }
+    bool is_mapped() const { return m_data != nullptr; }
+
+private:
+    void _unmap();
+    void _move_from(MappedFile& other);
+
+private:
+    void* m_data = nullptr;
+    usize m_size = 0;
+    // file and mapping handles on windows
+    void* m_file_handle    = nullptr;
+    void* m_mapping_handle = nullptr;
+};
+
+} // namespace vke
\ No newline at end of file
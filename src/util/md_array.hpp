@@ -1,14 +1,319 @@
 #pragma once
 
 #include "../common.hpp"
+#include "md_span.hpp"
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <bit>
+#include <exception>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <span>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#if defined(__BMI2__)
+#define VKE_MD_ARRAY_BMI2
+#include <immintrin.h>
+#endif
 
 namespace vke {
 
-template <class TValue, usize Dim>
+namespace impl {
+
+inline u64 deposit_bits(u64 value, u64 mask) {
+#if defined(VKE_MD_ARRAY_BMI2)
+    return _pdep_u64(value, mask);
+#else
+    u64 result = 0;
+    for (u64 bit = 1; mask != 0; mask &= mask - 1, bit <<= 1) {
+        if (value & bit) result |= mask & -mask;
+    }
+    return result;
+#endif
+}
+
+inline u64 extract_bits(u64 value, u64 mask) {
+#if defined(VKE_MD_ARRAY_BMI2)
+    return _pext_u64(value, mask);
+#else
+    u64 result = 0;
+    for (u64 bit = 1; mask != 0; mask &= mask - 1, bit <<= 1) {
+        if (value & mask & -mask) result |= bit;
+    }
+    return result;
+#endif
+}
+
+// inserts stride - 1 zero bits between the bits of value, the fast path of deposit_bits for evenly interleaved masks
+inline u64 spread_bits(u64 x, u32 stride) {
+    switch (stride) {
+    case 1: return x;
+    case 2:
+        x &= 0xffffffff;
+        x = (x | (x << 16)) & 0x0000ffff0000ffff;
+        x = (x | (x << 8)) & 0x00ff00ff00ff00ff;
+        x = (x | (x << 4)) & 0x0f0f0f0f0f0f0f0f;
+        x = (x | (x << 2)) & 0x3333333333333333;
+        x = (x | (x << 1)) & 0x5555555555555555;
+        return x;
+    case 3:
+        x &= 0x1fffff;
+        x = (x | (x << 32)) & 0x001f00000000ffff;
+        x = (x | (x << 16)) & 0x001f0000ff0000ff;
+        x = (x | (x << 8)) & 0x100f00f00f00f00f;
+        x = (x | (x << 4)) & 0x10c30c30c30c30c3;
+        x = (x | (x << 2)) & 0x1249249249249249;
+        return x;
+    default: {
+        u64 mask = 0;
+        for (u32 bit = 0; bit < 64; bit += stride) mask |= 1ull << bit;
+        return deposit_bits(x, mask);
+    }
+    }
+}
+
+// the inverse of spread_bits
+inline u64 compact_bits(u64 x, u32 stride) {
+    switch (stride) {
+    case 1: return x;
+    case 2:
+        x &= 0x5555555555555555;
+        x = (x | (x >> 1)) & 0x3333333333333333;
+        x = (x | (x >> 2)) & 0x0f0f0f0f0f0f0f0f;
+        x = (x | (x >> 4)) & 0x00ff00ff00ff00ff;
+        x = (x | (x >> 8)) & 0x0000ffff0000ffff;
+        x = (x | (x >> 16)) & 0x00000000ffffffff;
+        return x;
+    case 3:
+        x &= 0x1249249249249249;
+        x = (x | (x >> 2)) & 0x10c30c30c30c30c3;
+        x = (x | (x >> 4)) & 0x100f00f00f00f00f;
+        x = (x | (x >> 8)) & 0x001f0000ff0000ff;
+        x = (x | (x >> 16)) & 0x001f00000000ffff;
+        x = (x | (x >> 32)) & 0x1fffff;
+        return x;
+    default: {
+        u64 mask = 0;
+        for (u32 bit = 0; bit < 64; bit += stride) mask |= 1ull << bit;
+        return extract_bits(x, mask);
+    }
+    }
+}
+
+} // namespace impl
+
+// layouts map an md index to an index in the storage of an MDArray. the last axis is the fastest one in all of them.
+// layouts other than row major round the sizes up and leave padding elements in the storage which foreach skips.
+
+// the plain layout, storage is a dense row major array
+struct RowMajorLayout {
+    template <usize Dim>
+    class mapping {
+    public:
+        using key_type                    = std::array<u32, Dim>;
+        static constexpr bool has_padding = false;
+
+        mapping() = default;
+        explicit mapping(const key_type& sizes) : m_sizes(sizes) {}
+
+        size_t storage_size() const {
+            size_t total_size = 1;
+            for (usize i = 0; i < Dim; i++) total_size *= m_sizes[i];
+            return total_size;
+        }
+
+        size_t operator()(const key_type& md_index) const {
+            size_t flat_index = 0;
+            for (usize i = 0; i < Dim; i++) flat_index = flat_index * m_sizes[i] + md_index[i];
+            return flat_index;
+        }
+
+        key_type key(size_t flat_index) const {
+            key_type md_index;
+            for (usize i = Dim; i-- > 0;) {
+                md_index[i] = flat_index % m_sizes[i];
+                flat_index /= m_sizes[i];
+            }
+            return md_index;
+        }
+
+        // turns the key of storage_index into the key of storage_index + 1
+        void advance(key_type& md_index, size_t /*storage_index*/) const {
+            for (usize i = Dim; i-- > 0;) {
+                if (++md_index[i] < m_sizes[i]) break;
+                md_index[i] = 0;
+            }
+        }
+
+    private:
+        key_type m_sizes = {};
+    };
+};
+
+// the array is split into TileSize^Dim bricks stored one after the other, so neighbours along every axis are usually in the same brick
+template <u32 TileSize = 8>
+struct TiledLayout {
+    static_assert(std::has_single_bit(TileSize), "tile size must be a power of two");
+
+    template <usize Dim>
+    class mapping {
+    public:
+        using key_type                    = std::array<u32, Dim>;
+        static constexpr bool has_padding = true;
+
+        mapping() = default;
+        explicit mapping(const key_type& sizes) {
+            for (usize i = 0; i < Dim; i++) m_tile_counts[i] = (sizes[i] + TileSize - 1) / TileSize;
+        }
+
+        size_t storage_size() const {
+            size_t tile_count = 1;
+            for (usize i = 0; i < Dim; i++) tile_count *= m_tile_counts[i];
+            return tile_count << (tile_shift * Dim);
+        }
+
+        size_t operator()(const key_type& md_index) const {
+            size_t tile_index = 0, local_index = 0;
+            for (usize i = 0; i < Dim; i++) {
+                tile_index  = tile_index * m_tile_counts[i] + (md_index[i] >> tile_shift);
+                local_index = (local_index << tile_shift) | (md_index[i] & (TileSize - 1));
+            }
+            return (tile_index << (tile_shift * Dim)) | local_index;
+        }
+
+        key_type key(size_t storage_index) const {
+            size_t tile_index  = storage_index >> (tile_shift * Dim);
+            size_t local_index = storage_index;
+
+            key_type md_index;
+            for (usize i = Dim; i-- > 0;) {
+                md_index[i] = u32((tile_index % m_tile_counts[i]) << tile_shift) | u32(local_index & (TileSize - 1));
+                tile_index /= m_tile_counts[i];
+                local_index >>= tile_shift;
+            }
+            return md_index;
+        }
+
+        // counts up inside the tile, the key is only divided out again when moving to the next tile
+        void advance(key_type& md_index, size_t storage_index) const {
+            for (usize i = Dim; i-- > 0;) {
+                if ((++md_index[i] & (TileSize - 1)) != 0) return;
+                md_index[i] -= TileSize;
+            }
+            md_index = key(storage_index + 1);
+        }
+
+    private:
+        static constexpr u32 tile_shift = std::countr_zero(TileSize);
+
+        key_type m_tile_counts = {};
+    };
+};
+
+// z-order curve. each axis is rounded up to a power of two and the bits of the indices are interleaved,
+// axes with fewer bits drop out of the interleaving once their bits run out so long thin arrays aren't padded to a cube.
+// uses pdep/pext when compiled with BMI2, otherwise the levels where every axis has a bit are interleaved with magic numbers
+struct MortonLayout {
+    template <usize Dim>
+    class mapping {
+    public:
+        using key_type                    = std::array<u32, Dim>;
+        static constexpr bool has_padding = true;
+
+        mapping() = default;
+        explicit mapping(const key_type& sizes) {
+            std::array<u32, Dim> bit_counts;
+            for (usize i = 0; i < Dim; i++) bit_counts[i] = sizes[i] > 1 ? std::bit_width(sizes[i] - 1) : 0;
+
+            u32 bit = 0;
+            for (u32 level = 0; level < 32; level++) {
+                for (usize i = Dim; i-- > 0;) {
+                    if (level >= bit_counts[i]) continue;
+                    if (bit >= 64) throw std::length_error("MDArray is too large for the morton layout");
+
+                    m_bit_axes[bit] = u8(i);
+                    m_bit_ranks[bit] = u8(level);
+                    m_masks[i] |= 1ull << bit++;
+                }
+            }
+
+            bool empty     = std::find(sizes.begin(), sizes.end(), 0u) != sizes.end();
+            m_storage_size = empty ? 0 : size_t(1) << bit;
+
+            // the low levels where every axis with bits takes part are a plain interleave, the axes drop out above them
+            m_even_levels = ~0u;
+            for (usize i = Dim; i-- > 0;) {
+                if (bit_counts[i] == 0) continue;
+
+                m_axis_shifts[i] = m_interleaved_axes++;
+                m_even_levels    = std::min(m_even_levels, bit_counts[i]);
+            }
+            if (m_interleaved_axes == 0) m_even_levels = 0;
+
+            for (usize i = 0; i < Dim; i++) m_high_masks[i] = m_masks[i] & ~low_mask(m_even_levels * m_interleaved_axes);
+        }
+
+        size_t storage_size() const { return m_storage_size; }
+
+        size_t operator()(const key_type& md_index) const {
+            u64 index = 0;
+            for (usize i = 0; i < Dim; i++) {
+#if defined(VKE_MD_ARRAY_BMI2)
+                index |= impl::deposit_bits(md_index[i], m_masks[i]);
+#else
+                if (m_masks[i] == 0) continue;
+
+                index |= impl::spread_bits(md_index[i] & low_mask(m_even_levels), m_interleaved_axes) << m_axis_shifts[i];
+                if (m_high_masks[i] != 0) index |= impl::deposit_bits(u64(md_index[i]) >> m_even_levels, m_high_masks[i]);
+#endif
+            }
+            return index;
+        }
+
+        key_type key(size_t storage_index) const {
+            key_type md_index;
+            for (usize i = 0; i < Dim; i++) {
+#if defined(VKE_MD_ARRAY_BMI2)
+                md_index[i] = u32(impl::extract_bits(storage_index, m_masks[i]));
+#else
+                if (m_masks[i] == 0) {
+                    md_index[i] = 0;
+                    continue;
+                }
+
+                u64 low = impl::compact_bits(storage_index >> m_axis_shifts[i], m_interleaved_axes) & low_mask(m_even_levels);
+                u64 high = m_high_masks[i] != 0 ? impl::extract_bits(storage_index, m_high_masks[i]) << m_even_levels : 0;
+                md_index[i] = u32(low | high);
+#endif
+            }
+            return md_index;
+        }
+
+        // incrementing the storage index clears its trailing ones and sets the next bit, which is applied to the axes those bits belong to
+        void advance(key_type& md_index, size_t storage_index) const {
+            u32 trailing_ones = std::countr_one(storage_index);
+            for (u32 bit = 0; bit < trailing_ones; bit++) md_index[m_bit_axes[bit]] -= 1u << m_bit_ranks[bit];
+            if (trailing_ones < 64) md_index[m_bit_axes[trailing_ones]] += 1u << m_bit_ranks[trailing_ones];
+        }
+
+    private:
+        static u64 low_mask(u32 bit_count) { return bit_count >= 64 ? ~0ull : (1ull << bit_count) - 1; }
+
+    private:
+        std::array<u64, Dim> m_masks      = {};
+        std::array<u64, Dim> m_high_masks = {};
+        std::array<u32, Dim> m_axis_shifts = {};
+        u32 m_interleaved_axes = 0, m_even_levels = 0;
+        std::array<u8, 64> m_bit_axes = {}, m_bit_ranks = {};
+        size_t m_storage_size         = 0;
+    };
+};
+
+template <class TValue, usize Dim, class Layout = RowMajorLayout>
 class MDArray {
 private:
     constexpr static size_t INVALID_INDEX = std::numeric_limits<size_t>::max();
@@ -17,27 +322,31 @@ public:
     using key_type       = std::array<u32, Dim>;
     using value_type     = TValue;
     using allocator_type = std::allocator<value_type>;
+    using layout_type    = Layout;
+    using mapping_type   = typename Layout::template mapping<Dim>;
 
 #pragma region ctor/dtor
 public: // c'tors / d'tors
     MDArray(const key_type& size, const TValue& initial_value = TValue()) {
         m_sizes          = size;
+        m_mapping        = mapping_type(size);
         size_t flat_size = calculate_flat_size();
 
         m_data = _allocate<TValue>(flat_size);
 
-        for (int i = 0; i < flat_size; i++) {
+        for (size_t i = 0; i < flat_size; i++) {
             std::construct_at(&m_data[i], initial_value);
         }
     }
 
     MDArray() {
-        m_data  = nullptr;
-        m_sizes = std::array<u32, Dim>(0);
+        m_data = nullptr;
+        m_sizes.fill(0);
     }
 
     MDArray(const MDArray& other) {
         m_sizes          = other.m_sizes;
+        m_mapping        = other.m_mapping;
         size_t flat_size = calculate_flat_size();
 
         m_data = _allocate<TValue>(flat_size);
@@ -52,6 +361,7 @@ public: // c'tors / d'tors
         _destroy();
 
         m_sizes          = other.m_sizes;
+        m_mapping        = other.m_mapping;
         size_t flat_size = calculate_flat_size();
 
         m_data = _allocate<TValue>(flat_size);
@@ -62,11 +372,13 @@ public: // c'tors / d'tors
     }
 
     MDArray(MDArray&& other) noexcept {
-        m_sizes = other.m_sizes;
-        m_data  = other.m_data;
+        m_sizes   = other.m_sizes;
+        m_mapping = other.m_mapping;
+        m_data    = other.m_data;
 
         other.m_data = nullptr;
         other.m_sizes.fill(0);
+        other.m_mapping = mapping_type();
     }
 
     MDArray& operator=(MDArray&& other) noexcept {
@@ -74,11 +386,13 @@ public: // c'tors / d'tors
 
         _destroy();
 
-        m_sizes = other.m_sizes;
-        m_data  = other.m_data;
+        m_sizes   = other.m_sizes;
+        m_mapping = other.m_mapping;
+        m_data    = other.m_data;
 
         other.m_data = nullptr;
         other.m_sizes.fill(0);
+        other.m_mapping = mapping_type();
         return *this;
     }
 
@@ -95,28 +409,29 @@ public: // lookup
 
 #pragma region util
 public: // util
+    const key_type& sizes() const { return m_sizes; }
+    const mapping_type& mapping() const { return m_mapping; }
+
+    // the whole storage in storage order, including the padding of tiled and morton layouts
     std::span<value_type> as_flat_span() { return std::span<value_type>(m_data, calculate_flat_size()); }
-    std::span<const value_type> as_flat_span() const { return std::span<value_type>(m_data, calculate_flat_size()); }
+    std::span<const value_type> as_flat_span() const { return std::span<const value_type>(m_data, calculate_flat_size()); }
 
-    void foreach (auto&& f) {
-        if constexpr (requires(value_type v, key_type k) { f(v, k); }) {
-            _indexed_foreach(f);
-        } else {
-            for (size_t i = 0, size = calculate_flat_size(); i < size; i++) {
-                f(m_data[i]);
-            }
-        }
-    }
+    // views over the array, only the row major layout can be viewed with strides
+    MDSpan<value_type, Dim> as_mdspan() requires std::is_same_v<Layout, RowMajorLayout> { return MDSpan<value_type, Dim>(m_data, m_sizes); }
+    MDSpan<const value_type, Dim> as_mdspan() const requires std::is_same_v<Layout, RowMajorLayout> { return MDSpan<const value_type, Dim>(m_data, m_sizes); }
 
-    void foreach (auto&& f) const {
-        if constexpr (requires(value_type v, key_type k) { f(v, k); }) {
-            _indexed_foreach<true>(f);
-        } else {
-            for (size_t i = 0, size = calculate_flat_size(); i < size; i++) {
-                f(m_data[i]);
-            }
-        }
-    }
+    MDSpan<value_type, Dim> subspan(const key_type& offset, const key_type& size) requires std::is_same_v<Layout, RowMajorLayout> { return as_mdspan().subspan(offset, size); }
+    MDSpan<const value_type, Dim> subspan(const key_type& offset, const key_type& size) const requires std::is_same_v<Layout, RowMajorLayout> { return as_mdspan().subspan(offset, size); }
+
+    // visits elements in storage order. f is called either with the value or with the value and its md index
+    void foreach (auto&& f) { _foreach_range<false>(f, 0, calculate_flat_size()); }
+    void foreach (auto&& f) const { _foreach_range<true>(f, 0, calculate_flat_size()); }
+
+    // foreach split into chunks of chunk_size storage elements which threads take in order. f is called concurrently.
+    // thread_count 0 uses every hardware thread, the calling thread is one of them. if f throws, no new chunks are started
+    // and the first exception is rethrown on the calling thread
+    void parallel_foreach(auto&& f, size_t chunk_size = 1 << 14, u32 thread_count = 0) { _parallel_foreach<false>(f, chunk_size, thread_count); }
+    void parallel_foreach(auto&& f, size_t chunk_size = 1 << 14, u32 thread_count = 0) const { _parallel_foreach<true>(f, chunk_size, thread_count); }
 
 private:
     void _destroy() {
@@ -131,22 +446,13 @@ private:
     }
 
 private:
-    size_t convert_to_flat_index(const key_type& md_index) const {
-        size_t final_index = 0;
-        for (int i = 0; i < Dim; i++) {
-            final_index = final_index * m_sizes[i] + md_index[i];
-        }
-        return final_index;
-    }
+    size_t convert_to_flat_index(const key_type& md_index) const { return m_mapping(md_index); }
 
     size_t convert_to_flat_index_checked(const key_type& md_index) const {
-        size_t final_index = 0;
-        for (int i = 0; i < Dim; i++) {
-            if (md_index >= m_sizes[i]) return INVALID_INDEX;
-
-            final_index = final_index * m_sizes[i] + md_index[i];
+        for (usize i = 0; i < Dim; i++) {
+            if (md_index[i] >= m_sizes[i]) return INVALID_INDEX;
         }
-        return final_index;
+        return m_mapping(md_index);
     }
 
     size_t convert_to_flat_index_checked_throws(const key_type& md_index) const {
@@ -156,34 +462,91 @@ private:
     }
 
     size_t calculate_flat_size() const {
-        size_t total_size = 1;
-        for (int i = 0; i < Dim; i++) {
-            total_size *= m_sizes[i];
-        }
-        return total_size;
+        return m_mapping.storage_size();
     }
 
-    template <bool is_const = false>
-    void _indexed_foreach(auto&& f) {
-        key_type md_indices;
-        _indexed_foreach<0, is_const>(f, 0, md_indices);
+    bool _in_bounds(const key_type& md_index) const {
+        for (usize i = 0; i < Dim; i++) {
+            if (md_index[i] >= m_sizes[i]) return false;
+        }
+        return true;
     }
 
-    template <size_t N, bool is_const = false>
-    void _indexed_foreach(auto&& f, size_t accumulated_flat_index, key_type& md_indices) {
-        u32& i = md_indices[N];
-        for (i = 0; i < m_sizes[N]; i++) {
-            size_t flat_index = accumulated_flat_index + i;
-            if constexpr (N == Dim) {
-                if constexpr (is_const) {
-                    f(const_cast<const value_type&>(m_data[flat_index]), md_indices);
+    template <bool is_const>
+    void _foreach_range(auto&& f, size_t begin, size_t end) const {
+        using ref_type = std::conditional_t<is_const, const value_type&, value_type&>;
+
+        constexpr bool indexed = requires(value_type v, key_type k) { f(v, k); };
+
+        if constexpr (!mapping_type::has_padding && !indexed) {
+            for (size_t i = begin; i < end; i++) f(static_cast<ref_type>(m_data[i]));
+        } else {
+            if (begin == end) return;
+
+            // keys are stepped along with the storage index instead of being computed for every element
+            key_type md_index = m_mapping.key(begin);
+            for (size_t i = begin; i < end; m_mapping.advance(md_index, i++)) {
+                if constexpr (mapping_type::has_padding) {
+                    if (!_in_bounds(md_index)) continue;
+                }
+
+                if constexpr (indexed) {
+                    f(static_cast<ref_type>(m_data[i]), md_index);
                 } else {
-                    f(m_data[flat_index], md_indices);
+                    f(static_cast<ref_type>(m_data[i]));
+                }
+            }
+        }
+    }
+
+    template <bool is_const>
+    void _parallel_foreach(auto&& f, size_t chunk_size, u32 thread_count) const {
+        size_t flat_size   = calculate_flat_size();
+        chunk_size         = std::max(chunk_size, size_t(1));
+        size_t chunk_count = (flat_size + chunk_size - 1) / chunk_size;
+
+        if (thread_count == 0) thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+        thread_count = u32(std::min<size_t>(thread_count, chunk_count));
+
+        if (thread_count <= 1) {
+            _foreach_range<is_const>(f, 0, flat_size);
+            return;
+        }
+
+        std::atomic<size_t> next_chunk = 0;
+
+        // the first exception is rethrown once every thread is joined, the others stop at their next chunk
+        std::exception_ptr exception;
+        std::mutex exception_mutex;
+        auto store_exception = [&] {
+            next_chunk = chunk_count;
+
+            std::lock_guard lock(exception_mutex);
+            if (!exception) exception = std::current_exception();
+        };
+
+        auto worker = [&] {
+            try {
+                for (size_t chunk = next_chunk++; chunk < chunk_count; chunk = next_chunk++) {
+                    _foreach_range<is_const>(f, chunk * chunk_size, std::min(flat_size, (chunk + 1) * chunk_size));
                 }
-            } else {
-                indexed_foreach<N + 1>(f, flat_index, md_indices);
+            } catch (...) {
+                store_exception();
             }
+        };
+
+        std::vector<std::thread> threads;
+        try {
+            threads.reserve(thread_count - 1);
+            for (u32 i = 1; i < thread_count; i++) threads.emplace_back(worker);
+        } catch (...) {
+            store_exception();
         }
+
+        worker();
+        for (auto& thread : threads) thread.join();
+
+        if (exception) std::rethrow_exception(exception);
     }
 
 #pragma region allocator
@@ -205,6 +568,7 @@ private: // allocator
 private:
     TValue* m_data = nullptr;
     key_type m_sizes;
+    mapping_type m_mapping;
 };
 
 } // namespace vke
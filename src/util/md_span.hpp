@@ -0,0 +1,153 @@
+#pragma once
+
+#include "../common.hpp"
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <span>
+#include <type_traits>
+
+namespace vke {
+
+// a non owning view of a box of elements with explicit strides (in elements). the last axis is the fastest one, as in MDArray.
+// rows along the last axis are contiguous when its stride is 1, which foreach_row hands out as spans so loops over them can be vectorized
+template <class T, usize Dim>
+class MDSpan {
+public:
+    using key_type     = std::array<u32, Dim>;
+    using strides_type = std::array<usize, Dim>;
+    using value_type   = std::remove_cv_t<T>;
+    using element_type = T;
+
+public:
+    MDSpan() = default;
+
+    // a dense row major view
+    MDSpan(T* data, const key_type& sizes) : m_data(data), m_sizes(sizes) {
+        usize stride = 1;
+        for (usize i = Dim; i-- > 0;) {
+            m_strides[i] = stride;
+            stride *= sizes[i];
+        }
+    }
+
+    MDSpan(T* data, const key_type& sizes, const strides_type& strides) : m_data(data), m_sizes(sizes), m_strides(strides) {}
+
+    // MDSpan<T> -> MDSpan<const T>
+    template <class U>
+        requires(std::is_same_v<const U, T> && !std::is_same_v<U, T>)
+    MDSpan(const MDSpan<U, Dim>& other) : MDSpan(other.data(), other.sizes(), other.strides()) {}
+
+public:
+    T& operator[](const key_type& index) const { return m_data[flat_offset(index)]; }
+
+    T* data() const { return m_data; }
+    const key_type& sizes() const { return m_sizes; }
+    const strides_type& strides() const { return m_strides; }
+
+    usize size() const {
+        usize total_size = 1;
+        for (usize i = 0; i < Dim; i++) total_size *= m_sizes[i];
+        return total_size;
+    }
+
+    bool empty() const { return size() == 0; }
+
+    usize flat_offset(const key_type& index) const {
+        usize offset = 0;
+        for (usize i = 0; i < Dim; i++) offset += index[i] * m_strides[i];
+        return offset;
+    }
+
+    // the box [offset, offset + size), with the strides of this span
+    MDSpan subspan(const key_type& offset, const key_type& size) const {
+        for (usize i = 0; i < Dim; i++) assert(offset[i] + size[i] <= m_sizes[i]);
+        return MDSpan(m_data + flat_offset(offset), size, m_strides);
+    }
+
+    bool is_row_contiguous() const { return Dim == 0 || m_strides[Dim - 1] == 1; }
+
+    // true if the elements are packed without gaps in row major order
+    bool is_contiguous() const {
+        usize stride = 1;
+        for (usize i = Dim; i-- > 0;) {
+            if (m_sizes[i] > 1 && m_strides[i] != stride) return false;
+            stride *= m_sizes[i];
+        }
+        return true;
+    }
+
+    // the row along the last axis starting at row_start, row_start[Dim - 1] is usually 0
+    std::span<T> row(const key_type& row_start) const {
+        assert(is_row_contiguous());
+        return std::span<T>(m_data + flat_offset(row_start), m_sizes[Dim - 1] - row_start[Dim - 1]);
+    }
+
+    // calls f(std::span<T> row, const key_type& row_start) for every row along the last axis
+    void foreach_row(auto&& f) const {
+        assert(is_row_contiguous());
+        if (empty()) return;
+
+        key_type index = {};
+        while (true) {
+            f(std::span<T>(m_data + flat_offset(index), m_sizes[Dim - 1]), const_cast<const key_type&>(index));
+
+            usize axis = Dim - 1;
+            while (axis-- > 0) {
+                if (++index[axis] < m_sizes[axis]) break;
+                index[axis] = 0;
+            }
+            if (axis == usize(-1)) return;
+        }
+    }
+
+    // calls f(T& value, const key_type& index) in row major order
+    void foreach (auto&& f) const {
+        if (empty()) return;
+
+        key_type index = {};
+        while (true) {
+            T* row = m_data + flat_offset(index);
+            for (index[Dim - 1] = 0; index[Dim - 1] < m_sizes[Dim - 1]; index[Dim - 1]++) {
+                f(row[index[Dim - 1] * m_strides[Dim - 1]], const_cast<const key_type&>(index));
+            }
+            index[Dim - 1] = 0;
+
+            usize axis = Dim - 1;
+            while (axis-- > 0) {
+                if (++index[axis] < m_sizes[axis]) break;
+                index[axis] = 0;
+            }
+            if (axis == usize(-1)) return;
+        }
+    }
+
+    // packs the elements into dst in row major order. dst needs room for size() elements
+    void copy_to(std::span<value_type> dst) const
+        requires std::is_trivially_copyable_v<value_type>
+    {
+        assert(dst.size() >= size());
+
+        if (is_contiguous()) {
+            memcpy(dst.data(), m_data, size() * sizeof(T));
+            return;
+        }
+
+        value_type* out = dst.data();
+        if (is_row_contiguous()) {
+            foreach_row([&](std::span<T> row, const key_type&) {
+                memcpy(out, row.data(), row.size_bytes());
+                out += row.size();
+            });
+        } else {
+            foreach ([&](T& value, const key_type&) { *out++ = value; });
+        }
+    }
+
+private:
+    T* m_data              = nullptr;
+    key_type m_sizes       = {};
+    strides_type m_strides = {};
+};
+
+} // namespace vke
@@ -0,0 +1,267 @@
+#include "slab_allocator.hpp"
+#include "util.hpp"
+
+#include <bit>
+
+namespace vke {
+
+namespace {
+
+u32 find_next_bit(const std::vector<u64>& words, u32 from, u32 bit_count, bool value) {
+    u32 word_index = from / 64;
+    if (word_index >= words.size()) return bit_count;
+
+    u64 invert = value ? 0 : ~0ull;
+    u64 word   = (words[word_index] ^ invert) & (~0ull << (from % 64));
+
+    while (word == 0) {
+        if (++word_index >= words.size()) return bit_count;
+        word = words[word_index] ^ invert;
+    }
+
+    return std::min(word_index * 64 + std::countr_zero(word), bit_count);
+}
+
+void set_bit_range(std::vector<u64>& words, u32 first, u32 count, bool value) {
+    for (u32 i = first; i < first + count; i++) {
+        if (value) words[i / 64] |= 1ull << (i % 64);
+        else words[i / 64] &= ~(1ull << (i % 64));
+    }
+}
+
+} // namespace
+
+SlabAllocator::SlabAllocator(u32 block_size, u32 page_size) {
+    assert(std::has_single_bit(page_size));
+
+    m_page_size           = page_size;
+    m_page_count          = block_size / page_size;
+    m_min_slot_size       = std::max(page_size / max_page_slots, 16u);
+    m_slot_words_per_page = (page_size / m_min_slot_size + slots_per_word - 1) / slots_per_word;
+
+    // sizes of the form 2^k * (4 + i) / 4, so slots waste at most 25% and every power of two is a class
+    for (u32 base = m_min_slot_size; base <= page_size; base *= 2) {
+        for (u32 i = 0; i < sub_class_count; i++) {
+            u32 slot_size = base + i * (base / sub_class_count);
+            if (slot_size > page_size) break;
+
+            m_size_classes.push_back(SizeClass{.slot_size = slot_size});
+        }
+    }
+
+    m_pages.resize(m_page_count);
+    m_slot_bits.resize(usize(m_page_count) * m_slot_words_per_page);
+    m_free_pages.resize((m_page_count + 63) / 64);
+
+    reset();
+}
+
+void SlabAllocator::reset() {
+    for (auto& page : m_pages) page = Page{};
+    for (auto& size_class : m_size_classes) size_class.partial_head = null_page;
+
+    std::fill(m_free_pages.begin(), m_free_pages.end(), 0);
+    set_bit_range(m_free_pages, 0, m_page_count, true);
+
+    m_allocation_count = 0;
+    m_allocated_bytes  = 0;
+    m_reserved_bytes   = 0;
+}
+
+u32 SlabAllocator::_size_class_index(u32 size) const {
+    size = std::max(size, m_min_slot_size);
+
+    u32 base  = std::bit_floor(size);
+    u32 step  = base / sub_class_count;
+    u32 level = std::countr_zero(base) - std::countr_zero(m_min_slot_size);
+    u32 sub   = (size - base + step - 1) / step;
+
+    return level * sub_class_count + sub;
+}
+
+std::optional<SlabAllocator::Allocation> SlabAllocator::allocate(u32 size, usize alignment) {
+    assert(std::has_single_bit(alignment) && alignment <= m_page_size);
+
+    size = std::max(size, 1u);
+
+    u32 offset;
+    u32 request = std::max(size, static_cast<u32>(alignment));
+
+    if (request > m_page_size) {
+        u32 count = (size + m_page_size - 1) / m_page_size;
+        u32 first = _take_pages(count);
+        if (first == null_page) return std::nullopt;
+
+        m_pages[first].size_class = large_page;
+        m_pages[first].used_slots = count;
+
+        offset = first * m_page_size;
+        m_reserved_bytes += u64(count) * m_page_size;
+    } else {
+        u32 class_index = _size_class_index(request);
+        // only powers of two are guaranteed to be multiples of the alignment
+        if (m_size_classes[class_index].slot_size % alignment != 0) {
+            class_index = _size_class_index(std::bit_ceil(m_size_classes[class_index].slot_size));
+        }
+
+        SizeClass& size_class = m_size_classes[class_index];
+
+        u32 page_index = size_class.partial_head;
+        if (page_index == null_page) {
+            page_index = _take_pages(1);
+            if (page_index == null_page) return std::nullopt;
+
+            _init_page(page_index, class_index);
+            _link_partial(page_index);
+        }
+
+        Page& page = m_pages[page_index];
+        u64* words = _slot_words(page_index);
+
+        u32 word_index = std::countr_zero(page.summary);
+        u32 slot       = word_index * slots_per_word + std::countr_zero(words[word_index]);
+
+        words[word_index] &= words[word_index] - 1;
+        if (words[word_index] == 0) page.summary &= ~(1ull << word_index);
+
+        if (++page.used_slots == page.slot_count) _unlink_partial(page_index);
+
+        offset = page_index * m_page_size + slot * size_class.slot_size;
+        m_reserved_bytes += size_class.slot_size;
+    }
+
+    m_max = std::max(m_max, offset + size);
+    m_allocation_count++;
+    m_allocated_bytes += size;
+
+    return Allocation{
+        .offset = offset,
+        .size   = size,
+    };
+}
+
+void SlabAllocator::free(Allocation allocation) {
+    u32 page_index = allocation.offset / m_page_size;
+    Page& page     = m_pages[page_index];
+
+    assert(page.size_class != free_page && "freeing an allocation that doesn't exist");
+
+    m_allocation_count--;
+    m_allocated_bytes -= allocation.size;
+
+    if (page.size_class == large_page) {
+        m_reserved_bytes -= u64(page.used_slots) * m_page_size;
+        _return_pages(page_index, page.used_slots);
+        return;
+    }
+
+    u32 slot_size = m_size_classes[page.size_class].slot_size;
+    u32 slot      = (allocation.offset - page_index * m_page_size) / slot_size;
+    u64* words    = _slot_words(page_index);
+
+    u32 word_index = slot / slots_per_word;
+    u64 bit        = 1ull << (slot % slots_per_word);
+    assert(!(words[word_index] & bit) && "double free");
+
+    words[word_index] |= bit;
+    page.summary |= 1ull << word_index;
+
+    m_reserved_bytes -= slot_size;
+
+    if (page.used_slots-- == page.slot_count) _link_partial(page_index);
+
+    // empty pages go back to the shared pool so other size classes can use them
+    if (page.used_slots == 0) {
+        _unlink_partial(page_index);
+        _return_pages(page_index, 1);
+    }
+}
+
+u32 SlabAllocator::_take_pages(u32 count) {
+    u32 first = find_next_bit(m_free_pages, 0, m_page_count, true);
+
+    while (first + count <= m_page_count) {
+        u32 end = find_next_bit(m_free_pages, first, m_page_count, false);
+        if (end - first >= count) {
+            set_bit_range(m_free_pages, first, count, false);
+            return first;
+        }
+
+        first = find_next_bit(m_free_pages, end, m_page_count, true);
+    }
+
+    return null_page;
+}
+
+void SlabAllocator::_return_pages(u32 first, u32 count) {
+    m_pages[first] = Page{};
+    set_bit_range(m_free_pages, first, count, true);
+}
+
+void SlabAllocator::_init_page(u32 page_index, u32 class_index) {
+    Page& page = m_pages[page_index];
+    u64* words = _slot_words(page_index);
+
+    page.size_class = class_index;
+    page.used_slots = 0;
+    page.slot_count = m_page_size / m_size_classes[class_index].slot_size;
+
+    u32 full_words = page.slot_count / slots_per_word;
+    u32 tail_slots = page.slot_count % slots_per_word;
+
+    for (u32 i = 0; i < m_slot_words_per_page; i++) {
+        if (i < full_words) words[i] = ~0ull;
+        else if (i == full_words && tail_slots) words[i] = (1ull << tail_slots) - 1;
+        else words[i] = 0;
+    }
+
+    u32 used_words = full_words + (tail_slots ? 1 : 0);
+    page.summary   = used_words == 64 ? ~0ull : (1ull << used_words) - 1;
+}
+
+void SlabAllocator::_link_partial(u32 page_index) {
+    Page& page            = m_pages[page_index];
+    SizeClass& size_class = m_size_classes[page.size_class];
+
+    page.prev = null_page;
+    page.next = size_class.partial_head;
+    if (page.next != null_page) m_pages[page.next].prev = page_index;
+
+    size_class.partial_head = page_index;
+}
+
+void SlabAllocator::_unlink_partial(u32 page_index) {
+    Page& page = m_pages[page_index];
+
+    if (page.prev != null_page) m_pages[page.prev].next = page.next;
+    else m_size_classes[page.size_class].partial_head = page.next;
+
+    if (page.next != null_page) m_pages[page.next].prev = page.prev;
+
+    page.prev = page.next = null_page;
+}
+
+SlabAllocator::Statistics SlabAllocator::get_statistics() const {
+    Statistics stats{
+        .allocation_count = m_allocation_count,
+        .allocated_bytes  = m_allocated_bytes,
+        .reserved_bytes   = m_reserved_bytes,
+    };
+
+    for (u64 word : m_free_pages) stats.free_page_count += std::popcount(word);
+    stats.used_page_count = m_page_count - stats.free_page_count;
+
+    u32 first = find_next_bit(m_free_pages, 0, m_page_count, true);
+    while (first < m_page_count) {
+        u32 end                = find_next_bit(m_free_pages, first, m_page_count, false);
+        stats.largest_free_run = std::max(stats.largest_free_run, end - first);
+        first                  = find_next_bit(m_free_pages, end, m_page_count, true);
+    }
+
+    if (m_reserved_bytes > 0) stats.internal_fragmentation = 1.f - f32(m_allocated_bytes) / f32(m_reserved_bytes);
+    if (stats.free_page_count > 0) stats.external_fragmentation = 1.f - f32(stats.largest_free_run) / f32(stats.free_page_count);
+
+    return stats;
+}
+
+} // namespace vke
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "vke/fwd.hpp"
+
+#include <optional>
+#include <vector>
+
+namespace vke {
+
+// offset allocator with the same interface as VirtualAllocator for sub-allocations that fall into a few sizes.
+// the block is split into pages, each page holds slots of a single size class and tracks them with a two level bitmap.
+// allocating and freeing slots is O(1), allocations larger than a page take a run of whole pages.
+// not thread safe, same as VirtualAllocator
+class SlabAllocator {
+public:
+    struct Allocation {
+        u32 offset = 0;
+        u32 size   = 0;
+    };
+
+    struct Statistics {
+        u32 allocation_count   = 0;
+        u64 allocated_bytes    = 0; // requested sizes
+        u64 reserved_bytes     = 0; // slot sizes and page runs holding the allocations
+        u32 used_page_count    = 0;
+        u32 free_page_count    = 0;
+        u32 largest_free_run   = 0; // in pages
+        f32 internal_fragmentation = 0.f; // 1 - allocated / reserved
+        f32 external_fragmentation = 0.f; // 1 - largest free run / free pages
+    };
+
+public:
+    std::optional<Allocation> allocate(u32 size, usize alignment = 1);
+    void free(Allocation allocation);
+    void reset();
+
+    u32 max_id() const { return m_max; }
+    u32 page_size() const { return m_page_size; }
+
+    Statistics get_statistics() const;
+
+public:
+    // page_size must be a power of two, the block size is rounded down to whole pages
+    SlabAllocator(u32 block_size, u32 page_size = 64 * 1024);
+
+    SlabAllocator(const SlabAllocator& other)            = delete;
+    SlabAllocator& operator=(const SlabAllocator& other) = delete;
+
+    SlabAllocator(SlabAllocator&& other)            = default;
+    SlabAllocator& operator=(SlabAllocator&& other) = default;
+
+private:
+    static constexpr u32 null_page        = ~0u;
+    static constexpr u32 free_page        = ~0u;
+    static constexpr u32 large_page       = ~0u - 1;
+    static constexpr u32 slots_per_word   = 64;
+    static constexpr u32 max_slot_words   = 64; // one summary word covers all the slot words of a page
+    static constexpr u32 max_page_slots   = slots_per_word * max_slot_words;
+    static constexpr u32 sub_class_bits   = 2;
+    static constexpr u32 sub_class_count  = 1 << sub_class_bits;
+
+    struct Page {
+        u32 size_class = free_page; // or large_page for the first page of a run
+        u32 used_slots = 0;         // or the page count for large runs
+        u32 slot_count = 0;
+        u32 prev = null_page, next = null_page; // in the partial list of the size class
+        u64 summary = 0;                        // bit i is set if slot word i has a free slot
+    };
+
+    struct SizeClass {
+        u32 slot_size    = 0;
+        u32 partial_head = null_page; // pages with at least one free slot
+    };
+
+    u32 _size_class_index(u32 size) const;
+    u32 _take_pages(u32 count);
+    void _return_pages(u32 first, u32 count);
+    void _init_page(u32 page, u32 size_class);
+    void _link_partial(u32 page);
+    void _unlink_partial(u32 page);
+    u64* _slot_words(u32 page) { return m_slot_bits.data() + usize(page) * m_slot_words_per_page; }
+
+private:
+    u32 m_page_size = 0, m_page_count = 0, m_min_slot_size = 0;
+    u32 m_slot_words_per_page = 0;
+    u32 m_max                 = 0;
+
+    std::vector<Page> m_pages;
+    std::vector<SizeClass> m_size_classes;
+    // set bits are free slots
+    std::vector<u64> m_slot_bits;
+    // set bits are free pages
+    std::vector<u64> m_free_pages;
+
+    u32 m_allocation_count = 0;
+    u64 m_allocated_bytes = 0, m_reserved_bytes = 0;
+};
+
+} // namespace vke
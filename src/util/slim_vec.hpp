@@ -5,43 +5,66 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <memory>
 #include <new>
 #include <optional>
+#include <ranges>
 #include <span>
 #include <stdexcept>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
+// msvc accepts [[no_unique_address]] but ignores it, only its own spelling removes the padding
+#ifdef _MSC_VER
+#define VKE_NO_UNIQUE_ADDRESS [[msvc::no_unique_address]]
+#else
+#define VKE_NO_UNIQUE_ADDRESS [[no_unique_address]]
+#endif
+
 namespace vke {
 
-template <class T, bool smallVec = false, size_t desired_stack_slots = 0>
+// the default SlimVec allocator. an allocator provides allocate, reallocate and deallocate with these signatures
+struct MallocAllocator {
+    void* allocate(size_t byte_size, size_t /*alignment*/) { return malloc(byte_size); }
+    void* reallocate(void* ptr, size_t /*old_byte_size*/, size_t new_byte_size, size_t /*alignment*/) { return realloc(ptr, new_byte_size); }
+    void deallocate(void* ptr, size_t /*byte_size*/) { free(ptr); }
+};
+
+template <class T, bool smallVec = false, size_t desired_stack_slots = 0, class Allocator = MallocAllocator>
 class SlimVec {
 public:
     using iterator       = T*;
     using const_iterator = const T*;
+    using allocator_type = Allocator;
 
 public: // c'tors
     SlimVec(size_t size, const T& val) { resize(size, val); }
     SlimVec(size_t size) { resize(size, T()); }
 
     SlimVec() = default;
-    SlimVec(const SlimVec& other) { _copy_from(other); }
+    explicit SlimVec(const Allocator& allocator) : m_allocator(allocator) {}
+    SlimVec(const SlimVec& other) : m_allocator(other.m_allocator) { _copy_from(other); }
     SlimVec(SlimVec&& other) { _move_from(std::move(other)); }
     ~SlimVec() { _cleanup(); }
 
     SlimVec& operator=(const SlimVec& other) {
         _copy_from(other);
-        return other;
+        return *this;
     }
     SlimVec& operator=(SlimVec&& other) {
         _move_from(std::move(other));
         return *this;
     }
 
+    // non-const SlimVec lvalues go to the copy c'tor so the allocator is copied
     template <class Container>
+        requires(std::ranges::range<Container> && !std::is_same_v<std::remove_cvref_t<Container>, SlimVec>)
     SlimVec(Container&& val) { assign(std::forward<Container>(val)); }
 
     template <class Container>
+        requires std::ranges::range<Container>
     SlimVec& operator=(Container&& val) {
         assign(std::forward<Container>(val));
         return *this;
@@ -58,28 +81,24 @@ public:
     void assign(const SlimVec& other) { _copy_from(other); }
     void assign(SlimVec&& other) { _move_from(std::move(other)); }
 
-    void assign(const std::vector<T>& std_vec) {
-        clear();
-        reserve(std_vec.size());
-        for (const auto& e : std_vec) {
-            push_back(e);
-        }
-    }
+    void assign(const std::vector<T>& std_vec) { _assign_contiguous(std_vec.data(), std_vec.size()); }
 
-    void assign(const std::initializer_list<T>& iterable) {
-        clear();
-        reserve(std::distance(iterable.begin(), iterable.end()));
-        for (const auto& e : iterable) {
-            push_back(e);
-        }
-    }
+    void assign(const std::initializer_list<T>& iterable) { _assign_contiguous(iterable.begin(), iterable.size()); }
 
     template <class Iterable>
     void assign(Iterable&& iterable) {
-        clear();
-        reserve(std::distance(iterable.begin(), iterable.end()));
-        for (const auto& e : iterable) {
-            push_back(e);
+        // non-const SlimVec lvalues end up here rather than in the copy overloads
+        if constexpr (std::is_same_v<std::remove_cvref_t<Iterable>, SlimVec>) {
+            _copy_from(iterable);
+        } else if constexpr (std::ranges::contiguous_range<Iterable> && std::ranges::sized_range<Iterable> &&
+                      std::is_same_v<std::remove_cv_t<std::ranges::range_value_t<Iterable>>, T>) {
+            _assign_contiguous(std::ranges::data(iterable), std::ranges::size(iterable));
+        } else {
+            clear();
+            reserve(std::distance(iterable.begin(), iterable.end()));
+            for (const auto& e : iterable) {
+                push_back(e);
+            }
         }
     }
 
@@ -159,8 +178,92 @@ public:
         _set_size(cur_size + 1);
     }
 
+    // appends count elements and returns them. trivially copyable elements are left uninitialized for the caller to fill
+    std::span<T> append_n(size_t count) {
+        uint32_t old_size = _size();
+        _ensure_capacity_for(old_size + count);
+
+        T* data = _data() + old_size;
+        if constexpr (!_trivially_relocatable) {
+            for (size_t i = 0; i < count; ++i) {
+                new (data + i) T();
+            }
+        }
+
+        _set_size(old_size + count);
+        return std::span<T>(data, count);
+    }
+
+    void append(std::span<const T> items) {
+        uint32_t old_size = _size();
+        size_t count      = items.size();
+        if (count == 0) return;
+
+        // items might point into this vector, which growing would free
+        const T* src = items.data();
+        if (src >= begin() && src < end()) {
+            size_t offset = src - begin();
+            _ensure_capacity_for(old_size + count);
+            src = _data() + offset;
+        } else {
+            _ensure_capacity_for(old_size + count);
+        }
+
+        _copy_construct(_data() + old_size, src, count);
+        _set_size(old_size + count);
+    }
+
+    void insert_range(const_iterator pos, std::span<const T> items) { insert_range_at(std::distance(cbegin(), pos), items); }
+
+    void insert_range_at(size_t index, std::span<const T> items) {
+        uint32_t old_size = _size();
+        size_t count      = items.size();
+        assert(index <= old_size);
+        if (count == 0) return;
+
+        if (items.data() + count > begin() && items.data() < end()) {
+            // the shift below would overwrite the source
+            SlimVec copy(m_allocator);
+            copy.append(items);
+            insert_range_at(index, copy.as_const_span());
+            return;
+        }
+
+        _ensure_capacity_for(old_size + count);
+        T* data = _data();
+
+        if constexpr (_trivially_relocatable) {
+            memmove(static_cast<void*>(data + index + count), data + index, (old_size - index) * sizeof(T));
+            memcpy(static_cast<void*>(data + index), items.data(), count * sizeof(T));
+        } else {
+            // shift the tail back to front, slots past the old end are still uninitialized
+            for (size_t i = old_size; i-- > index;) {
+                if (i + count >= old_size) new (data + i + count) T(std::move(data[i]));
+                else data[i + count] = std::move(data[i]);
+            }
+
+            for (size_t i = 0; i < count; ++i) {
+                if (index + i < old_size) data[index + i] = items[i];
+                else new (data + index + i) T(items[i]);
+            }
+        }
+
+        _set_size(old_size + count);
+    }
+
     void reserve(size_t new_capacity) { _set_capacity(std::max(static_cast<uint32_t>(new_capacity), _size())); }
 
+    // like resize but new elements are left uninitialized
+    void resize_uninitialized(size_t new_size) {
+        static_assert(_trivially_relocatable, "resize_uninitialized requires a trivially copyable type");
+
+        if (_capacity() < new_size) {
+            _set_capacity(new_size);
+        }
+
+        _set_size(new_size);
+    }
+
     void resize(size_t __new_size, const T& value = T()) {
         uint32_t new_size = __new_size;
         uint32_t old_size = _size();
@@ -175,8 +278,12 @@ public:
         T* data = _data();
 
         if (new_size > old_size) {
-            for (uint32_t i = old_size; i < new_size; i++) {
-                new (data + i) T(value);
+            if constexpr (_trivially_relocatable) {
+                std::uninitialized_fill_n(data + old_size, new_size - old_size, value);
+            } else {
+                for (uint32_t i = old_size; i < new_size; i++) {
+                    new (data + i) T(value);
+                }
             }
         } else {
             for (uint32_t i = new_size; i < old_size; i++) {
@@ -277,6 +384,8 @@ public:
     size_t capacity() const { return _capacity(); }
     size_t size() const { return _size(); }
 
+    const Allocator& get_allocator() const { return m_allocator; }
+
     void clear() {
         auto* data = _data();
         for (int i = 0; i < _size(); ++i) {
@@ -304,6 +413,13 @@ private:
         }
     }
 
+    // grows geometrically so repeated appends stay amortized O(1)
+    void _ensure_capacity_for(size_t required_size) {
+        if (required_size > _capacity()) {
+            _set_capacity(std::max(required_size, _calculate_new_capacity()));
+        }
+    }
+
     size_t _calculate_new_capacity() const {
         size_t current_cap = _capacity();
 
@@ -325,7 +441,7 @@ private:
         }
 
         if (!is_small_vec() && _capacity() > 0) {
-            free(data);
+            m_allocator.deallocate(data, _capacity() * sizeof(T));
         }
 
         m_data_ptr = nullptr;
@@ -336,14 +452,20 @@ private:
     void _move_from(SlimVec&& other) {
         _cleanup();
 
+        m_allocator = other.m_allocator;
+
         if (other.is_small_vec()) {
             m_size = other.m_size;
 
             T* data = _data();
 
-            for (int i = 0; i < other._size(); ++i) {
-                new (data + i) T(std::move(other[i]));
-                other[i].~T();
+            if constexpr (_trivially_relocatable) {
+                memcpy(static_cast<void*>(data), other._data(), other._size() * sizeof(T));
+            } else {
+                for (int i = 0; i < other._size(); ++i) {
+                    new (data + i) T(std::move(other[i]));
+                    other[i].~T();
+                }
             }
 
             other.m_size = 0;
@@ -359,6 +481,8 @@ private:
     }
 
     void _copy_from(const SlimVec& other) {
+        if (this == &other) return;
+
         _cleanup();
 
         uint32_t o_size = other._size();
@@ -369,8 +493,30 @@ private:
 
         T* data = _data();
 
-        for (int i = 0; i < o_size; ++i) {
-            new (data + i) T(other[i]);
+        if constexpr (_trivially_relocatable) {
+            if (o_size > 0) memcpy(static_cast<void*>(data), other._data(), o_size * sizeof(T));
+        } else {
+            for (int i = 0; i < o_size; ++i) {
+                new (data + i) T(other[i]);
+            }
+        }
+    }
+
+    void _assign_contiguous(const T* src, size_t count) {
+        clear();
+        reserve(count);
+
+        _copy_construct(_data(), src, count);
+        _set_size(count);
+    }
+
+    static void _copy_construct(T* dst, const T* src, size_t count) {
+        if constexpr (_trivially_relocatable) {
+            if (count > 0) memcpy(static_cast<void*>(dst), src, count * sizeof(T));
+        } else {
+            for (size_t i = 0; i < count; ++i) {
+                new (dst + i) T(src[i]);
+            }
         }
     }
 
@@ -398,8 +544,29 @@ private:
         }
 
         uint32_t new_capacity = min_capacity;
+        if (new_capacity == 0 && m_capacity == 0) return;
+
+        if constexpr (_trivially_relocatable) {
+            // realloc can grow the block in place, glibc also remaps large blocks with mremap instead of copying
+            if (!is_small_vec_at_start) {
+                if (new_capacity == 0) {
+                    m_allocator.deallocate(m_data_ptr, m_capacity * sizeof(T));
+                    m_data_ptr = nullptr;
+                    m_capacity = 0;
+                    return;
+                }
+
+                T* new_data = reinterpret_cast<T*>(m_allocator.reallocate(m_data_ptr, m_capacity * sizeof(T), new_capacity * sizeof(T), alignof(T)));
+                if (new_data == nullptr) throw std::bad_alloc();
+
+                m_data_ptr = new_data;
+                m_capacity = new_capacity;
+                return;
+            }
+        }
 
-        T* new_data = reinterpret_cast<T*>(malloc(new_capacity * sizeof(T)));
+        T* new_data = reinterpret_cast<T*>(m_allocator.allocate(new_capacity * sizeof(T), alignof(T)));
+        if (new_data == nullptr) throw std::bad_alloc();
 
         T* old_data       = _data();
         uint32_t cur_size = _size();
@@ -408,13 +575,17 @@ private:
             m_size = cur_size; // we set it normally to make it non small vec
         }
 
-        for (uint32_t i = 0; i < cur_size; ++i) {
-            new (new_data + i) T(std::move(old_data[i]));
-            old_data[i].~T();
+        if constexpr (_trivially_relocatable) {
+            if (cur_size > 0) memcpy(static_cast<void*>(new_data), old_data, cur_size * sizeof(T));
+        } else {
+            for (uint32_t i = 0; i < cur_size; ++i) {
+                new (new_data + i) T(std::move(old_data[i]));
+                old_data[i].~T();
+            }
         }
 
         if (old_data != nullptr && !is_small_vec_at_start) {
-            free(old_data);
+            m_allocator.deallocate(old_data, m_capacity * sizeof(T));
         }
 
         m_data_ptr = new_data;
@@ -458,15 +629,24 @@ private: // fields
     // on the small vec mode, from the start of m_data_ptr to begining of m_size is used for storage
     size_t m_extra_dummy_storage[calculate_data_array_size()];
     uint32_t m_capacity = 0, m_size = _small_vec ? _small_vec_base_size : 0;
+    // outside of the small vec storage. takes no space when the allocator is stateless
+    VKE_NO_UNIQUE_ADDRESS Allocator m_allocator;
 
 private:
+    // trivially copyable types can be moved around with memcpy/realloc
+    constexpr static bool _trivially_relocatable = std::is_trivially_copyable_v<T>;
+
     constexpr static size_t _small_vec_byte_space    = offsetof(SlimVec, m_size);
     constexpr static size_t _small_vec_item_capacity = _small_vec_byte_space / sizeof(T);
     constexpr static bool _small_vec                 = smallVec && _small_vec_item_capacity >= 1;
     constexpr static uint32_t _small_vec_base_size   = UINT32_MAX - (_small_vec_item_capacity + 1);
 };
 
-template <class T, size_t MinStackSlots = 0>
-using SmallVec = SlimVec<T, true, MinStackSlots>;
+template <class T, size_t MinStackSlots = 0, class Allocator = MallocAllocator>
+using SmallVec = SlimVec<T, true, MinStackSlots, Allocator>;
+
+// the default allocator must not change the layout
+static_assert(sizeof(SlimVec<int>) == sizeof(int*) + 2 * sizeof(uint32_t));
+static_assert(sizeof(SmallVec<int, 8>) == sizeof(SlimVec<int>) + 3 * sizeof(size_t));
 
 } // namespace vke
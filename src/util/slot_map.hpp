@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <utility>
+
+#include "id_manager.hpp"
+#include "slim_vec.hpp"
+
+namespace vke {
+
+// a handle into a SlotMap. the generation is bumped every time the slot is erased so stale handles fail lookups
+struct SlotHandle {
+    uint32_t index      = 0;
+    uint32_t generation = 0; // 0 is never a live generation, so a default constructed handle is null
+
+    bool is_null() const { return generation == 0; }
+    uint64_t as_u64() const { return (uint64_t(generation) << 32) | index; }
+    static SlotHandle from_u64(uint64_t v) { return SlotHandle{.index = uint32_t(v), .generation = uint32_t(v >> 32)}; }
+
+    bool operator==(const SlotHandle& other) const = default;
+};
+
+// slot indices are recycled with an IDManager, values are kept packed in insertion order (until erases swap them around)
+// so iterating over them is as fast as iterating a vector. insert, erase and lookup are O(1).
+template <class T>
+class SlotMap {
+public:
+    using Handle = SlotHandle;
+
+public:
+    template <class... Args>
+    Handle emplace(Args&&... args) {
+        // the value is constructed first so a throwing constructor leaves no id or slot behind
+        uint32_t dense_index = static_cast<uint32_t>(m_values.size());
+        m_values.emplace_back(std::forward<Args>(args)...);
+
+        uint32_t index = m_ids.new_id();
+        if (index == m_slots.size()) m_slots.push_back(Slot{});
+
+        Slot& slot       = m_slots[index];
+        slot.dense_index = dense_index;
+
+        m_dense_to_slot.push_back(index);
+
+        return Handle{.index = index, .generation = slot.generation};
+    }
+
+    Handle insert(T&& value) { return emplace(std::move(value)); }
+    Handle insert(const T& value) { return emplace(value); }
+
+    // the last value is moved into the place of the erased one
+    bool erase(Handle handle) {
+        if (!contains(handle)) return false;
+
+        Slot& slot           = m_slots[handle.index];
+        uint32_t dense_index = slot.dense_index;
+        uint32_t last_index  = static_cast<uint32_t>(m_values.size() - 1);
+
+        if (dense_index != last_index) {
+            m_values[dense_index]        = std::move(m_values[last_index]);
+            m_dense_to_slot[dense_index] = m_dense_to_slot[last_index];
+
+            m_slots[m_dense_to_slot[dense_index]].dense_index = dense_index;
+        }
+
+        m_values.pop_back();
+        m_dense_to_slot.pop_back();
+
+        slot.dense_index = null_index;
+        if (++slot.generation == 0) slot.generation = 1;
+
+        m_ids.free_id(handle.index);
+        return true;
+    }
+
+    bool contains(Handle handle) const {
+        return handle.index < m_slots.size() && m_slots[handle.index].generation == handle.generation && m_slots[handle.index].dense_index != null_index;
+    }
+
+    // returns nullptr for stale handles
+    T* get(Handle handle) { return contains(handle) ? &m_values[m_slots[handle.index].dense_index] : nullptr; }
+    const T* get(Handle handle) const { return contains(handle) ? &m_values[m_slots[handle.index].dense_index] : nullptr; }
+
+    T& at(Handle handle) {
+        T* value = get(handle);
+        if (value == nullptr) throw std::out_of_range("stale or invalid slot handle");
+        return *value;
+    }
+
+    const T& at(Handle handle) const {
+        const T* value = get(handle);
+        if (value == nullptr) throw std::out_of_range("stale or invalid slot handle");
+        return *value;
+    }
+
+    T& operator[](Handle handle) {
+        assert(contains(handle));
+        return m_values[m_slots[handle.index].dense_index];
+    }
+
+    const T& operator[](Handle handle) const {
+        assert(contains(handle));
+        return m_values[m_slots[handle.index].dense_index];
+    }
+
+    // handle of the value at a dense index, for iterating values together with their handles
+    Handle handle_at(size_t dense_index) const {
+        uint32_t index = m_dense_to_slot[dense_index];
+        return Handle{.index = index, .generation = m_slots[index].generation};
+    }
+
+    void clear() {
+        for (uint32_t i = 0; i < m_dense_to_slot.size(); i++) {
+            Slot& slot       = m_slots[m_dense_to_slot[i]];
+            slot.dense_index = null_index;
+            if (++slot.generation == 0) slot.generation = 1;
+
+            m_ids.free_id(m_dense_to_slot[i]);
+        }
+
+        m_values.clear();
+        m_dense_to_slot.clear();
+    }
+
+    void reserve(size_t n) {
+        m_values.reserve(n);
+        m_dense_to_slot.reserve(n);
+        m_slots.reserve(n);
+    }
+
+    size_t size() const { return m_values.size(); }
+    bool empty() const { return m_values.empty(); }
+
+    // values are iterated densely, in no particular order
+    T* begin() { return m_values.begin(); }
+    T* end() { return m_values.end(); }
+    const T* begin() const { return m_values.begin(); }
+    const T* end() const { return m_values.end(); }
+
+    std::span<T> values() { return m_values.as_span(); }
+    std::span<const T> values() const { return m_values.as_const_span(); }
+
+private:
+    static constexpr uint32_t null_index = UINT32_MAX;
+
+    struct Slot {
+        uint32_t dense_index = null_index;
+        uint32_t generation  = 1;
+    };
+
+private:
+    IDManager<uint32_t> m_ids;
+    SlimVec<Slot> m_slots;
+    SlimVec<T> m_values;
+    SlimVec<uint32_t> m_dense_to_slot;
+};
+
+} // namespace vke
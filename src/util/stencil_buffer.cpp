@@ -1,16 +1,256 @@
 #include "stencil_buffer.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
 #include "../commandbuffer.hpp"
+#include "../vulkan_context.hpp"
 #include "util.hpp"
 
 namespace vke {
 
-StencilBuffer::StencilBuffer(u32 block_size, bool growable) {
+namespace {
+// sorts the copies by destination and merges the ones that follow each other in both buffers. returns the new count.
+// overlapping destination regions are unsupported: the regions of a vkCmdCopyBuffer are written in no defined order, so the
+// sort doesn't try to keep the order they were recorded in. they are only reported
+usize merge_copies(std::span<VkBufferCopy> copies, u32 max_gap) {
+    if (copies.size() <= 1) return copies.size();
+
+    std::sort(copies.begin(), copies.end(), [](const VkBufferCopy& a, const VkBufferCopy& b) { return a.dstOffset < b.dstOffset; });
+
+    VkDeviceSize max_dst_end = copies[0].dstOffset + copies[0].size;
+    bool overlapping         = false;
+
+    usize count = 1;
+    for (usize i = 1; i < copies.size(); i++) {
+        VkBufferCopy& last   = copies[count - 1];
+        const auto& copy     = copies[i];
+        VkDeviceSize dst_end = last.dstOffset + last.size;
+        VkDeviceSize src_end = last.srcOffset + last.size;
+
+        overlapping |= copy.dstOffset < max_dst_end;
+        max_dst_end = std::max(max_dst_end, copy.dstOffset + copy.size);
+
+        bool mergeable = copy.dstOffset >= dst_end && copy.srcOffset >= src_end &&
+                         copy.dstOffset - dst_end == copy.srcOffset - src_end && copy.dstOffset - dst_end <= max_gap;
+
+        if (mergeable) {
+            last.size = copy.dstOffset + copy.size - last.dstOffset;
+        } else {
+            copies[count++] = copy;
+        }
+    }
+
+    if (overlapping) LOG_WARNING("overlapping copies to the same destination in one flush, the result is undefined");
+
+    return count;
+}
+} // namespace
+
+struct StencilBuffer::LaneState {
+    struct Block {
+        RCResource<vke::Buffer> buffer;
+        std::atomic<u64> top = 0; // may run past the end of the buffer, chunks are only valid if they end before it
+    };
+
+    u32 block_size;
+    bool growable;
+
+    // lanes take chunks from the current block with a fetch_add, the mutex is only locked to replace it once it is full
+    std::atomic<Block*> current_block = nullptr;
+    // lanes between loading current_block and their fetch_add. replaced blocks are only freed while it is 0
+    std::atomic<u32> acquiring = 0;
+
+    // guards everything below
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Block>> blocks;
+    CopyLists copies;
+    std::vector<RCResource<Resource>> references;
+    u64 pending_bytes = 0, direct_bytes = 0;
+    std::vector<DirectFlush> direct_flushes;
+
+    struct Chunk {
+        // taken while acquiring is held, the block may be freed as soon as it is released
+        RCResource<Resource> reference;
+        vke::Buffer* buffer;
+        u32 offset;
+    };
+
+    // returns a chunk of size bytes
+    Chunk acquire_chunk(u32 size) {
+        while (true) {
+            acquiring.fetch_add(1);
+            Block* block = current_block.load();
+            if (block != nullptr) {
+                u64 offset = block->top.fetch_add(size, std::memory_order_relaxed);
+                if (offset + size <= block->buffer->byte_size()) {
+                    Chunk chunk{
+                        .reference = block->buffer->get_reference(),
+                        .buffer    = block->buffer.get(),
+                        .offset    = u32(offset),
+                    };
+                    acquiring.fetch_sub(1);
+                    return chunk;
+                }
+            }
+            acquiring.fetch_sub(1);
+
+            std::lock_guard lock(mutex);
+            // another lane already replaced it
+            if (current_block.load(std::memory_order_relaxed) != block) continue;
+
+            if (block != nullptr && !growable) {
+                THROW_ERROR("failed to allocate a %d byte staging chunk. buffer isn't growable!", size);
+            }
+
+            auto new_block    = std::make_unique<Block>();
+            new_block->buffer = std::make_unique<vke::Buffer>(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, std::max(block_size, size), MemoryAccess::Upload);
+
+            current_block.store(new_block.get());
+            blocks.push_back(std::move(new_block));
+        }
+    }
+};
+
+StencilBuffer::StencilBuffer(u32 block_size, bool growable, Mode mode) {
     m_growable        = growable;
     m_buffer_capacity = block_size;
+    m_mode            = mode;
+
+    m_lanes             = std::make_unique<LaneState>();
+    m_lanes->block_size = block_size;
+    m_lanes->growable   = growable;
+}
+
+StencilBuffer::~StencilBuffer()                                    = default;
+StencilBuffer::StencilBuffer(StencilBuffer&&) noexcept            = default;
+StencilBuffer& StencilBuffer::operator=(StencilBuffer&&) noexcept = default;
+
+StencilBuffer::Lane StencilBuffer::create_lane(u32 chunk_size) {
+    return Lane(m_lanes.get(), chunk_size);
+}
+
+#pragma region Lane
+
+StencilBuffer::Lane::Lane(Lane&& other) noexcept
+    : m_state(other.m_state), m_chunk_size(other.m_chunk_size), m_chunk_buffer(other.m_chunk_buffer), m_chunk_top(other.m_chunk_top),
+      m_chunk_end(other.m_chunk_end), m_copies(std::move(other.m_copies)), m_references(std::move(other.m_references)),
+      m_pending_bytes(other.m_pending_bytes), m_direct_bytes(other.m_direct_bytes), m_direct_flushes(std::move(other.m_direct_flushes)) {
+    other.m_state        = nullptr;
+    other.m_chunk_buffer = nullptr;
+}
+
+StencilBuffer::Lane& StencilBuffer::Lane::operator=(Lane&& other) noexcept {
+    if (this == &other) return *this;
+
+    this->~Lane();
+    new (this) Lane(std::move(other));
+    return *this;
+}
+
+StencilBuffer::Lane::~Lane() {
+    if (m_state) submit();
+}
+
+BufferSpan StencilBuffer::Lane::allocate(u32 byte_size) {
+    assert(m_state && "lane was moved from");
+
+    if (m_chunk_buffer == nullptr || m_chunk_end - m_chunk_top < byte_size) take_chunk(byte_size);
+
+    auto bspan = m_chunk_buffer->subspan(m_chunk_top, byte_size);
+    m_chunk_top += byte_size;
+    m_pending_bytes += byte_size;
+
+    return bspan;
+}
+
+void StencilBuffer::Lane::take_chunk(u32 min_size) {
+    // whatever is left of the current chunk is wasted
+    auto chunk = m_state->acquire_chunk(std::max(m_chunk_size, min_size));
+
+    // the lane already holds a reference to the block it was allocating from
+    if (chunk.buffer != m_chunk_buffer) m_references.push_back(std::move(chunk.reference));
+
+    m_chunk_buffer = chunk.buffer;
+    m_chunk_top    = chunk.offset;
+    m_chunk_end    = chunk.offset + std::max(m_chunk_size, min_size);
+}
+
+void StencilBuffer::Lane::copy_data(BufferSpan destination, std::span<const u8> data) {
+    memcpy(reserve(destination, data.size(), 1).data(), data.data(), data.size_bytes());
+}
+
+std::span<u8> StencilBuffer::Lane::reserve_upload(BufferSpan destination, u32 byte_size) {
+    return reserve(destination, byte_size, 1);
+}
+
+void StencilBuffer::Lane::copy_data_direct(BufferSpan destination, std::span<const u8> data) {
+    auto direct = direct_span(destination, data.size(), 1);
+    if (!direct.has_value()) return copy_data(destination, data);
+
+    // flushed right away so nothing points to destination after the call
+    memcpy(direct->data(), data.data(), data.size_bytes());
+    destination.flush(0, data.size());
+    m_direct_bytes += data.size();
+}
+
+std::span<u8> StencilBuffer::Lane::reserve_upload_direct(BufferSpan destination, u32 byte_size) {
+    return reserve(destination, byte_size, 1, true);
+}
+
+std::span<u8> StencilBuffer::Lane::reserve(BufferSpan destination, u32 byte_size, u32 alignment, bool direct) {
+    assert(destination.byte_size() >= byte_size);
+
+    if (direct) {
+        if (auto direct = direct_span(destination, byte_size, alignment)) {
+            if ((destination.memory_properties() & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0) m_direct_flushes.push_back(direct_flush(destination, byte_size));
+
+            m_direct_bytes += byte_size;
+            return *direct;
+        }
+    }
+
+    auto staging = align_allocation(allocate(byte_size + alignment - 1), byte_size, alignment);
+
+    m_copies[std::make_pair(destination.vke_buffer(), staging.vke_buffer())].push_back(VkBufferCopy{
+        .srcOffset = staging.byte_offset(),
+        .dstOffset = destination.byte_offset(),
+        .size      = staging.byte_size(),
+    });
+
+    return staging.mapped_data_bytes();
 }
 
+void StencilBuffer::Lane::submit() {
+    if (m_copies.empty() && m_pending_bytes == 0 && m_direct_bytes == 0) return;
+
+    std::lock_guard lock(m_state->mutex);
+
+    for (auto& [buffer_pair, copies] : m_copies) {
+        auto& dst = m_state->copies[buffer_pair];
+        for (auto& copy : copies) dst.push_back(copy);
+    }
+    m_copies.clear();
+
+    for (auto& reference : m_references) m_state->references.push_back(std::move(reference));
+    m_references.clear();
+    // the chunk is still allocated from, so its block needs a new reference for the copies recorded after this
+    if (m_chunk_buffer) m_references.push_back(m_chunk_buffer->get_reference());
+
+    for (auto& flush : m_direct_flushes) m_state->direct_flushes.push_back(std::move(flush));
+    m_direct_flushes.clear();
+
+    m_state->pending_bytes += m_pending_bytes;
+    m_state->direct_bytes += m_direct_bytes;
+    m_pending_bytes = m_direct_bytes = 0;
+}
+
+#pragma endregion
+
 BufferSpan StencilBuffer::allocate(u32 byte_size, bool allow_grow) {
+    if (m_mode == Mode::Ring) return ring_allocate(byte_size, allow_grow);
+
     if (m_top + byte_size > m_buffer_capacity) {
         if (!allow_grow) {
             THROW_ERROR("failed to allocate %d bytes. available space %d", byte_size, m_buffer_capacity - m_top);
@@ -22,15 +262,88 @@ BufferSpan StencilBuffer::allocate(u32 byte_size, bool allow_grow) {
 
     auto bspan = get_top_buffer()->subspan(m_top, byte_size);
     m_top += byte_size;
+
+    m_pending_bytes += byte_size;
+    update_peak();
+
     return bspan;
 }
 
+BufferSpan StencilBuffer::ring_allocate(u32 byte_size, bool allow_grow) {
+    // not aligned, same as linear mode. keeps consecutive uploads adjacent in the staging buffer so their copies can be merged
+    u32 size = byte_size;
+
+    if (m_buffers.empty()) {
+        m_buffers.push_back(std::make_unique<vke::Buffer>(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, m_buffer_capacity, MemoryAccess::Upload));
+    }
+
+    auto try_place = [&]() -> std::optional<u32> {
+        if (m_ring_used == 0) m_top = m_ring_tail = 0;
+        if (m_ring_used == m_buffer_capacity) return std::nullopt;
+
+        if (m_top >= m_ring_tail) {
+            if (m_buffer_capacity - m_top >= size) return m_top;
+
+            // the end of the buffer is too small, skip it and wrap around. the skipped bytes are freed along with this frame
+            if (m_ring_tail >= size) {
+                u32 skipped = m_buffer_capacity - m_top;
+                m_ring_used += skipped;
+                m_pending_bytes += skipped;
+                return 0;
+            }
+        } else if (m_ring_tail - m_top >= size) {
+            return m_top;
+        }
+
+        return std::nullopt;
+    };
+
+    auto offset = try_place();
+    if (!offset.has_value()) {
+        reclaim();
+        offset = try_place();
+    }
+
+    if (!offset.has_value()) {
+        if (!allow_grow || !m_growable) {
+            THROW_ERROR("failed to allocate %d bytes from the staging ring. %d of %d bytes are in use", byte_size, m_ring_used, m_buffer_capacity);
+        }
+
+        grow_ring(size);
+        offset = try_place();
+        assert(offset.has_value());
+    }
+
+    m_top = *offset + size;
+    m_ring_used += size;
+    m_pending_bytes += size;
+    update_peak();
+
+    return m_buffers.back()->subspan(*offset, byte_size);
+}
+
+void StencilBuffer::grow_ring(u32 min_capacity) {
+    // the old buffer still holds this frame's data, it is kept until the next flush hands it to the command buffer
+    m_retired_buffers.push_back(std::move(m_buffers.back()));
+    m_buffers.clear();
+
+    m_buffer_capacity = std::max(m_buffer_capacity * 2, min_capacity);
+    m_buffers.push_back(std::make_unique<vke::Buffer>(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, m_buffer_capacity, MemoryAccess::Upload));
+
+    // frames in flight are only in the old buffers, which the command buffers they were flushed to keep alive
+    m_in_flight_frames.clear();
+    m_top = m_ring_tail = m_ring_used = m_in_flight_bytes = 0;
+    m_grow_count++;
+}
+
 void StencilBuffer::push_new_buffer() {
     if (m_buffers.size() > 0 && !m_growable) {
         THROW_ERROR("failed to grow buffer. buffer isn't growable!");
     }
 
-    m_buffers.push_back(std::make_unique<vke::Buffer>(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, m_buffer_capacity, true));
+    if (m_buffers.size() > 0) m_grow_count++;
+
+    m_buffers.push_back(std::make_unique<vke::Buffer>(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, m_buffer_capacity, MemoryAccess::Upload));
     m_top = 0;
 }
 
@@ -40,26 +353,230 @@ vke::Buffer* StencilBuffer::get_top_buffer() {
 }
 
 void StencilBuffer::copy_data(BufferSpan destination, std::span<const u8> data) {
-    assert(destination.byte_size() >= data.size_bytes());
+    memcpy(reserve(destination, data.size(), 1).data(), data.data(), data.size_bytes());
+}
+
+std::span<u8> StencilBuffer::reserve_upload(BufferSpan destination, u32 byte_size) {
+    return reserve(destination, byte_size, 1);
+}
+
+void StencilBuffer::copy_data_direct(BufferSpan destination, std::span<const u8> data) {
+    auto direct = direct_span(destination, data.size(), 1);
+    if (!direct.has_value()) return copy_data(destination, data);
+
+    // flushed right away so nothing points to destination after the call
+    memcpy(direct->data(), data.data(), data.size_bytes());
+    destination.flush(0, data.size());
+    m_direct_bytes += data.size();
+}
+
+std::span<u8> StencilBuffer::reserve_upload_direct(BufferSpan destination, u32 byte_size) {
+    return reserve(destination, byte_size, 1, true);
+}
 
-    auto allocation = allocate(data.size());
-    memcpy(allocation.mapped_data_bytes().data(), data.data(), data.size_bytes());
+std::span<u8> StencilBuffer::reserve(BufferSpan destination, u32 byte_size, u32 alignment, bool direct) {
+    assert(destination.byte_size() >= byte_size);
 
-    m_copies[std::make_pair(destination.vke_buffer(), allocation.vke_buffer())].push_back(VkBufferCopy{
-        .srcOffset = allocation.byte_offset(),
+    if (direct) {
+        if (auto direct = direct_span(destination, byte_size, alignment)) {
+            if ((destination.memory_properties() & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0) m_direct_flushes.push_back(direct_flush(destination, byte_size));
+
+            m_direct_bytes += byte_size;
+            return *direct;
+        }
+    }
+
+    auto allocation = allocate_aligned(byte_size, alignment);
+    record_copy(destination, allocation);
+    return allocation.mapped_data_bytes();
+}
+
+std::optional<std::span<u8>> StencilBuffer::direct_span(BufferSpan destination, u32 byte_size, u32 alignment) {
+    // host visible system memory is slower for the gpu to read than a copy into device local memory
+    constexpr VkMemoryPropertyFlags required = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    if ((destination.memory_properties() & required) != required) return std::nullopt;
+
+    auto bytes = destination.mapped_data_bytes();
+    if (bytes.data() == nullptr || reinterpret_cast<uintptr_t>(bytes.data()) % alignment != 0) return std::nullopt;
+
+    return bytes.subspan(0, byte_size);
+}
+
+StencilBuffer::DirectFlush StencilBuffer::direct_flush(BufferSpan destination, u32 byte_size) {
+    auto* resource = dynamic_cast<Resource*>(destination.vke_buffer());
+
+    return DirectFlush{
+        .span      = destination.subspan(0, byte_size),
+        .reference = resource ? resource->try_get_reference() : RCResource<Resource>(),
+    };
+}
+
+BufferSpan StencilBuffer::align_allocation(BufferSpan allocation, u32 byte_size, u32 alignment) {
+    auto address = reinterpret_cast<uintptr_t>(allocation.mapped_data_bytes().data());
+    u32 padding  = u32((alignment - address % alignment) % alignment);
+
+    return allocation.vke_buffer()->subspan(allocation.byte_offset() + padding, byte_size);
+}
+
+BufferSpan StencilBuffer::allocate_aligned(u32 byte_size, u32 alignment) {
+    if (alignment <= 1) return allocate(byte_size);
+    return align_allocation(allocate(byte_size + alignment - 1), byte_size, alignment);
+}
+
+void StencilBuffer::record_copy(BufferSpan destination, BufferSpan staging) {
+    assert(destination.byte_size() >= staging.byte_size());
+
+    m_copies[std::make_pair(destination.vke_buffer(), staging.vke_buffer())].push_back(VkBufferCopy{
+        .srcOffset = staging.byte_offset(),
         .dstOffset = destination.byte_offset(),
-        .size      = data.size_bytes(),
+        .size      = staging.byte_size(),
     });
 }
 
 void StencilBuffer::flush_copies(vke::CommandBuffer& cmd) {
+    assert(m_mode == Mode::Linear && "ring mode needs a timeline value or a fence to know when the space can be reused");
+
+    record_copies(cmd);
+    end_frame(UINT64_MAX, VK_NULL_HANDLE);
+}
+
+void StencilBuffer::flush_copies(vke::CommandBuffer& cmd, u64 timeline_value) {
+    record_copies(cmd);
+    end_frame(timeline_value, VK_NULL_HANDLE);
+}
+
+void StencilBuffer::flush_copies(vke::CommandBuffer& cmd, VkFence fence) {
+    record_copies(cmd);
+    end_frame(UINT64_MAX, fence);
+}
+
+void StencilBuffer::collect_lane_copies(vke::CommandBuffer& cmd) {
+    std::lock_guard lock(m_lanes->mutex);
+
+    for (auto& [buffer_pair, copies] : m_lanes->copies) {
+        auto& dst = m_copies[buffer_pair];
+        for (auto& copy : copies) dst.push_back(copy);
+    }
+    m_lanes->copies.clear();
+
+    for (auto& reference : m_lanes->references) cmd.add_execution_dependency(std::move(reference));
+    m_lanes->references.clear();
+
+    m_pending_bytes += m_lanes->pending_bytes;
+    m_direct_bytes += m_lanes->direct_bytes;
+    m_lanes->pending_bytes = m_lanes->direct_bytes = 0;
+
+    for (auto& flush : m_lanes->direct_flushes) m_direct_flushes.push_back(std::move(flush));
+    m_lanes->direct_flushes.clear();
+    update_peak();
+
+    // full blocks only stay alive through the lanes still using them and the command buffers reading them.
+    // a lane that loaded a block before it was replaced may still be about to bump its top, those are kept until the next flush.
+    // the current block can't change while the mutex is held, so lanes starting after the check only see that one
+    auto* current = m_lanes->current_block.load();
+    if (m_lanes->acquiring.load() == 0) {
+        std::erase_if(m_lanes->blocks, [&](const auto& block) { return block.get() != current; });
+    }
+}
+
+void StencilBuffer::record_copies(vke::CommandBuffer& cmd) {
+    collect_lane_copies(cmd);
+
     for (auto& [buffer_pair, copies] : m_copies) {
         auto [dst_buffer, src_buffer] = buffer_pair;
+
+        m_copies_recorded += copies.size();
+        copies.resize(merge_copies(copies, m_max_merge_gap));
+        m_copies_submitted += copies.size();
+
+        // one flush over everything the copies read, a no-op for coherent staging memory
+        VkDeviceSize flush_begin = UINT64_MAX, flush_end = 0;
+        for (auto& copy : copies) {
+            flush_begin = std::min(flush_begin, copy.srcOffset);
+            flush_end   = std::max(flush_end, copy.srcOffset + copy.size);
+        }
+        src_buffer->flush_mapped_range(flush_begin, flush_end - flush_begin);
+
         cmd.copy_buffer(src_buffer, dst_buffer, copies);
     }
+    m_copies.clear();
+
+    for (auto& flush : m_direct_flushes) flush.span.flush();
+    m_direct_flushes.clear();
 
-    for(auto buffer : m_buffers){
+    for(auto& buffer : m_buffers){
         cmd.add_execution_dependency(buffer->get_reference());
-    }    
+    }
+    for (auto& buffer : m_retired_buffers) {
+        cmd.add_execution_dependency(buffer->get_reference());
+    }
+    m_retired_buffers.clear();
 }
-} // namespace vke
\ No newline at end of file
+
+void StencilBuffer::end_frame(u64 timeline_value, VkFence fence) {
+    m_pending_bytes = 0;
+
+    if (m_mode == Mode::Linear) {
+        // full blocks are never allocated from again, the command buffer now keeps them alive until it is done
+        if (m_buffers.size() > 1) m_buffers.erase(m_buffers.begin(), m_buffers.end() - 1);
+        return;
+    }
+
+    u32 frame_bytes = m_ring_used - m_in_flight_bytes;
+    if (frame_bytes == 0) return;
+
+    m_in_flight_frames.push_back(InFlightFrame{
+        .end            = m_top,
+        .byte_size      = frame_bytes,
+        .timeline_value = timeline_value,
+        .fence          = fence,
+    });
+    m_in_flight_bytes += frame_bytes;
+}
+
+void StencilBuffer::reclaim(u64 completed_timeline_value) {
+    m_completed_timeline_value = std::max(m_completed_timeline_value, completed_timeline_value);
+
+    // frames finish in submission order, so the first unfinished one stops the search
+    while (!m_in_flight_frames.empty()) {
+        auto& frame = m_in_flight_frames.front();
+
+        bool finished = frame.fence != VK_NULL_HANDLE
+                            ? vkGetFenceStatus(VulkanContext::get_context()->get_device(), frame.fence) == VK_SUCCESS
+                            : frame.timeline_value <= m_completed_timeline_value;
+        if (!finished) break;
+
+        m_ring_tail = frame.end;
+        m_ring_used -= frame.byte_size;
+        m_in_flight_bytes -= frame.byte_size;
+        m_in_flight_frames.pop_front();
+    }
+}
+
+StencilBuffer::Statistics StencilBuffer::get_statistics() const {
+    u64 capacity = u64(m_buffer_capacity) * m_buffers.size();
+    for (const auto& buffer : m_retired_buffers) capacity += buffer->byte_size();
+
+    {
+        std::lock_guard lock(m_lanes->mutex);
+        for (const auto& block : m_lanes->blocks) capacity += block->buffer->byte_size();
+    }
+
+    return Statistics{
+        .capacity         = capacity,
+        .pending_bytes    = m_pending_bytes,
+        .in_flight_bytes  = m_in_flight_bytes,
+        .peak_bytes       = m_peak_bytes,
+        .in_flight_frames = static_cast<u32>(m_in_flight_frames.size()),
+        .grow_count       = m_grow_count,
+        .copies_recorded  = m_copies_recorded,
+        .copies_submitted = m_copies_submitted,
+        .direct_bytes     = m_direct_bytes,
+    };
+}
+
+void StencilBuffer::update_peak() {
+    m_peak_bytes = std::max(m_peak_bytes, m_pending_bytes + m_in_flight_bytes);
+}
+
+} // namespace vke
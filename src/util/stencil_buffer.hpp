@@ -1,26 +1,147 @@
 #pragma once
 
+#include <deque>
+#include <memory>
 #include <unordered_map>
 #include <vector>
 
+#include <vulkan/vulkan_core.h>
+
 #include <vke/fwd.hpp>
 
 #include "../buffer.hpp"
 #include "slim_vec.hpp"
 
 #include "hash_util.hpp"
+#include "md_span.hpp"
 #include "util.hpp"
 
 namespace vke {
 
 class StencilBuffer {
+    struct LaneState;
+    // pair as dst buffer,src buffer
+    using CopyLists = std::unordered_map<std::pair<IBuffer*, IBuffer*>, vke::SlimVec<VkBufferCopy>>;
+
+    // a reserve_upload_direct span in non coherent memory, flushed by the next flush_copies.
+    // reference keeps reference counted destinations alive until then
+    struct DirectFlush {
+        BufferSpan span;
+        RCResource<Resource> reference;
+    };
+
+public:
+    enum class Mode {
+        // bump allocates from new blocks, blocks are only released once they are full and flushed
+        Linear,
+        // a single buffer used as a ring. the space of a flush is reclaimed once the gpu is done with it,
+        // the buffer only grows if the data in flight doesn't fit
+        Ring,
+    };
+
+    struct Statistics {
+        u64 capacity         = 0; // bytes of staging memory owned, lane blocks and retired ring buffers included
+        u64 pending_bytes    = 0; // allocated since the last flush
+        u64 in_flight_bytes  = 0; // flushed but not yet reclaimed, ring mode only
+        u64 peak_bytes       = 0; // highest pending + in flight bytes seen
+        u32 in_flight_frames = 0;
+        u32 grow_count       = 0;
+        u64 copies_recorded  = 0; // copy regions requested since creation
+        u64 copies_submitted = 0; // copy regions left after merging
+        u64 direct_bytes     = 0; // written straight into device local destinations by the direct calls, without staging
+    };
+
+    // a staging allocator for a single worker thread. lanes take chunks out of staging blocks shared by all lanes of a StencilBuffer
+    // with an atomic offset and bump allocate inside them without any locking. the copies a lane records are handed to the
+    // StencilBuffer by submit, the next flush_copies on the render thread records them together with its own.
+    // lane blocks are separate from the ones allocate uses and are released like linear mode blocks in both modes
+    class Lane {
+    public:
+        Lane(Lane&& other) noexcept;
+        Lane& operator=(Lane&& other) noexcept;
+        Lane(const Lane&)            = delete;
+        Lane& operator=(const Lane&) = delete;
+
+        // submits anything left
+        ~Lane();
+
+        BufferSpan allocate(u32 byte_size);
+
+        void copy_data(BufferSpan destination, std::span<const u8> data);
+
+        template <class T>
+        void copy_data(BufferSpan destination, const T* data, usize count /*not in bytes rather in amount*/) {
+            copy_data(destination, std::span<const u8>(reinterpret_cast<const u8*>(data), count * sizeof(T)));
+        }
+
+        template <class T>
+        void copy_data(BufferSpan destination, std::span<const T> data) {
+            copy_data(destination, vke::span_cast<const u8>(data));
+        }
+
+        // same as StencilBuffer::reserve_upload
+        std::span<u8> reserve_upload(BufferSpan destination, u32 byte_size);
+
+        template <class T>
+        std::span<T> reserve_upload(BufferSpan destination, usize count /*not in bytes rather in amount*/) {
+            return vke::span_cast<T>(reserve(destination, count * sizeof(T), alignof(T)));
+        }
+
+        // same as StencilBuffer::copy_data_direct and reserve_upload_direct
+        void copy_data_direct(BufferSpan destination, std::span<const u8> data);
+
+        template <class T>
+        void copy_data_direct(BufferSpan destination, std::span<const T> data) {
+            copy_data_direct(destination, vke::span_cast<const u8>(data));
+        }
+
+        std::span<u8> reserve_upload_direct(BufferSpan destination, u32 byte_size);
+
+        template <class T>
+        std::span<T> reserve_upload_direct(BufferSpan destination, usize count /*not in bytes rather in amount*/) {
+            return vke::span_cast<T>(reserve(destination, count * sizeof(T), alignof(T), true));
+        }
+
+        // hands the recorded copies to the StencilBuffer. they are recorded by the next flush_copies that starts after submit returns
+        void submit();
+
+    private:
+        friend StencilBuffer;
+        Lane(LaneState* state, u32 chunk_size) : m_state(state), m_chunk_size(chunk_size) {}
+
+        void take_chunk(u32 min_size);
+        std::span<u8> reserve(BufferSpan destination, u32 byte_size, u32 alignment, bool direct = false);
+
+    private:
+        LaneState* m_state = nullptr;
+        u32 m_chunk_size   = 0;
+
+        vke::Buffer* m_chunk_buffer = nullptr;
+        u32 m_chunk_top = 0, m_chunk_end = 0;
+
+        CopyLists m_copies;
+        // the blocks the recorded copies read from
+        std::vector<RCResource<Resource>> m_references;
+        u64 m_pending_bytes = 0, m_direct_bytes = 0;
+        std::vector<DirectFlush> m_direct_flushes;
+    };
+
 public:
     // 256KiB block size by default. not enough for images
-    StencilBuffer(u32 block_size = 1 << 18, bool growable = true);
+    StencilBuffer(u32 block_size = 1 << 18, bool growable = true, Mode mode = Mode::Linear);
+    ~StencilBuffer();
+
+    StencilBuffer(StencilBuffer&&) noexcept;
+    StencilBuffer& operator=(StencilBuffer&&) noexcept;
+
+    // lanes take chunk_size bytes at a time, or more for larger allocations. a lane may be used by one thread at a time and
+    // must not outlive the StencilBuffer. any number of lanes may be used concurrently with each other and with the StencilBuffer itself
+    Lane create_lane(u32 chunk_size = 1 << 16);
 
     BufferSpan allocate(u32 byte_size, bool allow_grow = true);
 
-    // requires flush_copies to be called to have data actually be copied
+    // requires flush_copies to be called to have data actually be copied. the destination ranges written between two flushes
+    // must not overlap, copies of one flush are recorded into the same command and reach the gpu in no defined order
     void copy_data(BufferSpan destination, std::span<const u8> data);
 
     template <class T>
@@ -33,21 +154,161 @@ public:
         copy_data(destination, vke::span_cast<const u8>(data));
     }
 
+    // returns mapped staging memory for byte_size bytes and records its copy to destination, so the data can be generated in place
+    // instead of being written to a temporary and copied by copy_data. the span has to be filled before flush_copies is called,
+    // which flushes non coherent staging memory. staging memory is write combined, write it sequentially and don't read from it
+    std::span<u8> reserve_upload(BufferSpan destination, u32 byte_size);
+
+    // the staging memory is aligned for T
+    template <class T>
+    std::span<T> reserve_upload(BufferSpan destination, usize count /*not in bytes rather in amount*/) {
+        return vke::span_cast<T>(reserve(destination, count * sizeof(T), alignof(T)));
+    }
+
+    // write straight into the mapped memory of destination instead of recording a copy if it is device local and host visible,
+    // e.g. a buffer created with MemoryAccess::DirectUpload on a device with resizable bar, and fall back to copy_data and
+    // reserve_upload otherwise. the write happens immediately rather than when the command buffer runs, so they are only for
+    // destinations the gpu isn't using, such as newly created buffers. copy_data_direct flushes non coherent memory right away
+    void copy_data_direct(BufferSpan destination, std::span<const u8> data);
+
+    template <class T>
+    void copy_data_direct(BufferSpan destination, std::span<const T> data) {
+        copy_data_direct(destination, vke::span_cast<const u8>(data));
+    }
+
+    // the span is written after the call, so non coherent memory is flushed by the next flush_copies. the destination buffer
+    // must stay alive until then, reference counted ones are kept alive by the StencilBuffer
+    std::span<u8> reserve_upload_direct(BufferSpan destination, u32 byte_size);
+
+    template <class T>
+    std::span<T> reserve_upload_direct(BufferSpan destination, usize count /*not in bytes rather in amount*/) {
+        return vke::span_cast<T>(reserve(destination, count * sizeof(T), alignof(T), true));
+    }
+
+    // packs the box straight into the staging memory, so the slice is copied once on the cpu instead of through a temporary buffer.
+    // destination receives the elements packed in row major order
+    template <class T, usize Dim>
+    void copy_data(BufferSpan destination, MDSpan<T, Dim> data) {
+        using value_type = std::remove_cv_t<T>;
+        data.copy_to(vke::span_cast<value_type>(reserve(destination, data.size() * sizeof(T), alignof(T))));
+    }
+
+    // packs the box into a staging allocation, flushes it and returns it, e.g. for Image::copy_from_buffer
+    template <class T, usize Dim>
+    BufferSpan stage_data(MDSpan<T, Dim> data) {
+        BufferSpan allocation = allocate_aligned(data.size() * sizeof(T), alignof(T));
+        data.copy_to(allocation.mapped_data<std::remove_cv_t<T>>());
+        // no copy is recorded for it, so flush_copies doesn't flush it
+        allocation.flush();
+        return allocation;
+    }
+
+    // records the copies into cmd and clears them, together with the ones submitted by lanes
     void flush_copies(vke::CommandBuffer& cmd);
 
+    // ring mode: the space allocated since the previous flush is reclaimed once the timeline value passed to reclaim reaches timeline_value
+    void flush_copies(vke::CommandBuffer& cmd, u64 timeline_value);
+    // ring mode: the space is reclaimed once the fence is signaled. reclaim must see the fence signaled before it is reset
+    void flush_copies(vke::CommandBuffer& cmd, VkFence fence);
+
+    // ring mode: frees the flushes that the gpu has finished. fences are polled, timeline values are compared to completed_timeline_value.
+    // allocate calls it with the last timeline value it was given when it runs out of space
+    void reclaim(u64 completed_timeline_value);
+    void reclaim() { reclaim(m_completed_timeline_value); }
+
+    // copies whose source and destination are both max_gap or fewer bytes apart are merged into one, which also copies the bytes between them.
+    // only for destinations where those bytes may be overwritten with unrelated staging data. 0 by default, which only merges adjacent copies
+    void set_max_merge_gap(u32 max_gap) { m_max_merge_gap = max_gap; }
+
+    Mode mode() const { return m_mode; }
+    Statistics get_statistics() const;
+
+private:
+    struct InFlightFrame {
+        u32 end            = 0; // the ring head at the time of the flush
+        u32 byte_size      = 0; // including the space skipped when wrapping around
+        u64 timeline_value = 0;
+        VkFence fence      = VK_NULL_HANDLE;
+    };
+
+    BufferSpan ring_allocate(u32 byte_size, bool allow_grow);
+    void grow_ring(u32 min_capacity);
+    void record_copies(vke::CommandBuffer& cmd);
+    void collect_lane_copies(vke::CommandBuffer& cmd);
+    void end_frame(u64 timeline_value, VkFence fence);
+    void update_peak();
+
 private:
+    // allocations are not aligned, so typed ones allocate alignment - 1 more bytes and take the aligned byte_size bytes out of them
+    static BufferSpan align_allocation(BufferSpan allocation, u32 byte_size, u32 alignment);
+    // the mapped memory of destination if it is device local and host visible
+    static std::optional<std::span<u8>> direct_span(BufferSpan destination, u32 byte_size, u32 alignment);
+    static DirectFlush direct_flush(BufferSpan destination, u32 byte_size);
+    BufferSpan allocate_aligned(u32 byte_size, u32 alignment);
+    // the memory the data for destination is written to, either staging memory with a recorded copy or, for direct writes, destination itself
+    std::span<u8> reserve(BufferSpan destination, u32 byte_size, u32 alignment, bool direct = false);
+    void record_copy(BufferSpan destination, BufferSpan staging);
     vke::Buffer* get_top_buffer();
     void push_new_buffer();
 
 private:
     // std::unordered_map<Buffer*, vke::SlimVec<VkBufferCopy>> m_copies;
 
-    // pair as dst buffer,src buffer
-    std::unordered_map<std::pair<IBuffer*, IBuffer*>, vke::SlimVec<VkBufferCopy>> m_copies;
+    CopyLists m_copies;
     std::vector<RCResource<vke::Buffer>> m_buffers;
     u32 m_top             = 0;
     u32 m_buffer_capacity = 0;
     bool m_growable;
+    Mode m_mode;
+
+    // ring state. m_buffers only holds the ring, the buffers it grew out of wait in m_retired_buffers until the next flush
+    std::deque<InFlightFrame> m_in_flight_frames;
+    std::vector<RCResource<vke::Buffer>> m_retired_buffers;
+    u32 m_ring_tail = 0, m_ring_used = 0, m_in_flight_bytes = 0;
+    u64 m_completed_timeline_value = 0;
+
+    u64 m_pending_bytes = 0, m_peak_bytes = 0;
+    u32 m_grow_count    = 0;
+
+    u32 m_max_merge_gap = 0;
+    u64 m_copies_recorded = 0, m_copies_submitted = 0, m_direct_bytes = 0;
+    std::vector<DirectFlush> m_direct_flushes;
+
+    // behind a pointer so lanes can keep pointing to it when the StencilBuffer is moved
+    std::unique_ptr<LaneState> m_lanes;
 };
 
+// a copy region for a 2D or 3D image reading span out of a buffer without packing it first, e.g. out of a mapped staging buffer
+// holding the whole array. buffer_base is the element that buffer_offset points to.
+// the last axis is x, the one before it y and the one before that z
+template <class T, usize Dim>
+    requires(Dim == 2 || Dim == 3)
+VkBufferImageCopy buffer_image_copy(const MDSpan<T, Dim>& span, const T* buffer_base, VkDeviceSize buffer_offset, const VkImageSubresourceLayers& subresource,
+    VkOffset3D image_offset = {}) {
+    assert(span.is_row_contiguous() && span.data() >= buffer_base);
+
+    const auto& sizes   = span.sizes();
+    const auto& strides = span.strides();
+
+    u32 row_length   = u32(strides[Dim - 2]);
+    u32 image_height = 0;
+    if constexpr (Dim == 3) {
+        assert(strides[0] % strides[1] == 0 && "slice stride must be a whole number of rows");
+        image_height = u32(strides[0] / strides[1]);
+    }
+
+    return VkBufferImageCopy{
+        .bufferOffset      = buffer_offset + VkDeviceSize(span.data() - buffer_base) * sizeof(T),
+        .bufferRowLength   = row_length,
+        .bufferImageHeight = image_height,
+        .imageSubresource  = subresource,
+        .imageOffset       = image_offset,
+        .imageExtent       = VkExtent3D{
+                  .width  = sizes[Dim - 1],
+                  .height = sizes[Dim - 2],
+                  .depth  = Dim == 3 ? sizes[0] : 1,
+        },
+    };
+}
+
 } // namespace vke
\ No newline at end of file
@@ -1,13 +1,16 @@
 #include "virtual_allocator.hpp"
 #include "util.hpp"
 
+#include <algorithm>
+
 #include <vk_mem_alloc.h>
 
 namespace vke {
 
 std::optional<VirtualAllocator::Allocation> VirtualAllocator::allocate(u32 size, usize alignment) {
     VmaVirtualAllocationCreateInfo alloc_info = {
-        .size = size,
+        .size      = size,
+        .alignment = alignment,
     };
 
     VmaVirtualAllocation alloc;
@@ -21,6 +24,12 @@ std::optional<VirtualAllocator::Allocation> VirtualAllocator::allocate(u32 size,
 
     m_max = std::max(m_max,offset + size);
 
+    m_live_allocations.insert_or_assign(offset, LiveAllocation{
+        .allocation = alloc,
+        .size       = size,
+        .alignment  = checked_integer_cast<u32>(std::max(alignment, usize(1))),
+    });
+
     return Allocation{
         .allocation = alloc,
         .offset     = offset,
@@ -30,6 +39,7 @@ std::optional<VirtualAllocator::Allocation> VirtualAllocator::allocate(u32 size,
 
 void VirtualAllocator::reset() {
     vmaClearVirtualBlock(m_virtual_block);
+    m_live_allocations.clear();
 }
 
 VirtualAllocator::VirtualAllocator(u32 block_size) {
@@ -54,7 +64,147 @@ VirtualAllocator::~VirtualAllocator() {
 }
 
 void VirtualAllocator::free(Allocation allocation) {
-    vmaVirtualFree(m_virtual_block, allocation.allocation);
+    auto it = m_live_allocations.find(allocation.offset);
+    if (it == m_live_allocations.end()) {
+        LOG_ERROR("no live virtual allocation at offset %u", allocation.offset);
+        return;
+    }
+
+    vmaVirtualFree(m_virtual_block, (*it).second.allocation);
+    m_live_allocations.erase(allocation.offset);
+}
+
+u32 VirtualAllocator::CompactionPlan::remap_offset(u32 old_offset) const {
+    auto it = std::lower_bound(remap.begin(), remap.end(), old_offset, [](const auto& entry, u32 offset) { return entry.first < offset; });
+    if (it == remap.end() || it->first != old_offset) return old_offset;
+
+    return it->second;
+}
+
+VirtualAllocator::CompactionPlan VirtualAllocator::plan_compaction(u64 max_bytes) const {
+    struct Range {
+        u32 begin, end;
+    };
+
+    std::vector<std::pair<u32, LiveAllocation>> live;
+    live.reserve(m_live_allocations.size());
+    for (const auto& [offset, allocation] : m_live_allocations) live.emplace_back(offset, allocation);
+
+    std::sort(live.begin(), live.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    // holes between live allocations. the space freed by moves isn't reused within the same plan,
+    // otherwise source and destination regions of the copy could overlap
+    std::vector<Range> holes;
+    u32 cursor = 0;
+    for (const auto& [offset, allocation] : live) {
+        if (offset > cursor) holes.push_back(Range{cursor, offset});
+        cursor = std::max(cursor, offset + allocation.size);
+    }
+
+    CompactionPlan plan;
+
+    // move from the top down so the used range of the block shrinks even when the budget stops the plan early
+    for (auto it = live.rbegin(); it != live.rend(); ++it) {
+        const auto& [offset, allocation] = *it;
+
+        if (holes.empty() || holes.front().begin >= offset) break;
+        if (plan.moved_bytes + allocation.size > max_bytes && !plan.empty()) break;
+
+        for (usize i = 0; i < holes.size() && holes[i].end <= offset; i++) {
+            Range hole = holes[i];
+            u32 dst    = round_up_to_multiple(hole.begin, allocation.alignment);
+            if (dst >= hole.end || hole.end - dst < allocation.size) continue;
+
+            Range before{hole.begin, dst}, after{dst + allocation.size, hole.end};
+
+            holes.erase(holes.begin() + i);
+            if (after.end > after.begin) holes.insert(holes.begin() + i, after);
+            if (before.end > before.begin) holes.insert(holes.begin() + i, before);
+
+            plan.copies.push_back(VkBufferCopy{
+                .srcOffset = offset,
+                .dstOffset = dst,
+                .size      = allocation.size,
+            });
+            plan.remap.emplace_back(offset, dst);
+            plan.moved_bytes += allocation.size;
+            break;
+        }
+    }
+
+    std::sort(plan.remap.begin(), plan.remap.end());
+
+    return plan;
+}
+
+void VirtualAllocator::apply_compaction(const CompactionPlan& plan) {
+    if (plan.empty()) return;
+
+    std::vector<std::pair<u32, LiveAllocation>> old_layout, new_layout;
+    old_layout.reserve(m_live_allocations.size());
+    new_layout.reserve(m_live_allocations.size());
+    for (const auto& [offset, allocation] : m_live_allocations) {
+        old_layout.emplace_back(offset, allocation);
+        new_layout.emplace_back(plan.remap_offset(offset), allocation);
+    }
+
+    if (_rebuild(new_layout)) return;
+
+    // the allocator has to keep matching the block, so fall back to the layout the allocations had before the plan
+    if (!_rebuild(old_layout)) THROW_ERROR("failed to restore the virtual block after a failed compaction");
+    THROW_ERROR("vma didn't place the compacted allocations at their planned offsets. the previous layout was restored, discard the plan's copies");
+}
+
+bool VirtualAllocator::_rebuild(std::vector<std::pair<u32, LiveAllocation>>& layout) {
+    std::sort(layout.begin(), layout.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    // vma can't allocate at a given offset, so the block is rebuilt instead. allocating in address order from an empty
+    // block always takes the start of the remaining free space, the holes are filled with padding allocations that are
+    // freed once every live allocation is placed
+    vmaClearVirtualBlock(m_virtual_block);
+    m_live_allocations.clear();
+
+    std::vector<VmaVirtualAllocation> paddings;
+    u32 cursor = 0;
+    m_max      = 0;
+
+    // checked in release builds too, a mismatch would leave m_live_allocations describing a different block
+    auto allocate_at = [&](u32 offset, u32 size) -> std::optional<VmaVirtualAllocation> {
+        VmaVirtualAllocationCreateInfo alloc_info = {
+            .size = size,
+        };
+
+        VmaVirtualAllocation alloc;
+        VkDeviceSize _offset;
+        VkResult res = vmaVirtualAllocate(m_virtual_block, &alloc_info, &alloc, &_offset);
+        if (res != VK_SUCCESS) return std::nullopt;
+        if (_offset != offset) {
+            vmaVirtualFree(m_virtual_block, alloc);
+            return std::nullopt;
+        }
+
+        return alloc;
+    };
+
+    for (auto& [offset, allocation] : layout) {
+        if (offset > cursor) {
+            auto padding = allocate_at(cursor, offset - cursor);
+            if (!padding.has_value()) return false;
+            paddings.push_back(*padding);
+        }
+
+        auto placed = allocate_at(offset, allocation.size);
+        if (!placed.has_value()) return false;
+
+        allocation.allocation = *placed;
+        m_live_allocations.insert_or_assign(offset, LiveAllocation(allocation));
+
+        cursor = offset + allocation.size;
+        m_max  = std::max(m_max, cursor);
+    }
+
+    for (auto padding : paddings) vmaVirtualFree(m_virtual_block, padding);
+    return true;
 }
 
-} // namespace vke
\ No newline at end of file
+} // namespace vke
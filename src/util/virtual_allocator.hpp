@@ -2,6 +2,11 @@
 
 #include "vke/fwd.hpp"
 #include <optional>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "hash_map.hpp"
 
 typedef struct VmaVirtualAllocation_T* VmaVirtualAllocation;
 typedef struct VmaVirtualBlock_T* VmaVirtualBlock;
@@ -17,11 +22,34 @@ public:
         u32 size                        = 0;
     };
 
+    // a set of moves that slides live allocations towards offset 0.
+    // destinations only cover space that is free before the plan, so all the copies can be recorded with a single
+    // CommandBuffer::copy_buffer on the buffer the allocator manages.
+    struct CompactionPlan {
+        std::vector<VkBufferCopy> copies;
+        std::vector<std::pair<u32, u32>> remap; // old offset -> new offset, sorted by the old offset
+        u64 moved_bytes = 0;
+
+        bool empty() const { return copies.empty(); }
+        // returns the offset unchanged if the allocation isn't moved by the plan
+        u32 remap_offset(u32 old_offset) const;
+    };
+
 public:
     std::optional<Allocation> allocate(u32 size, usize alignment = 1);
+    // allocations are looked up by their offset, so after a compaction only the offsets of moved allocations need patching
     void free(Allocation allocation);
     void reset();
 
+    // moves allocations from the top of the block into the lowest holes they fit. at most max_bytes are moved,
+    // except that a single allocation larger than max_bytes is still moved so the compaction can't stall.
+    // call it every frame with a budget to compact incrementally, or repeatedly until empty() for a full compaction.
+    CompactionPlan plan_compaction(u64 max_bytes = UINT64_MAX) const;
+    // updates the allocator to the layout of the plan. the copies must have been recorded before any new allocation is written to.
+    // throws if vma doesn't place the allocations where the plan put them, the allocator keeps its previous layout in that case
+    // and the copies of the plan must not be submitted
+    void apply_compaction(const CompactionPlan& plan);
+
     u32 max_id() const { return m_max; }
 
     VmaVirtualBlock get_virtual_block() { return m_virtual_block; }
@@ -35,18 +63,37 @@ public:
 
     VirtualAllocator(VirtualAllocator&& other) {
         m_virtual_block       = other.m_virtual_block;
+        m_capacity            = other.m_capacity;
+        m_max                 = other.m_max;
+        m_live_allocations    = std::move(other.m_live_allocations);
         other.m_virtual_block = nullptr;
     }
 
     VirtualAllocator& operator=(VirtualAllocator&& other) {
         m_virtual_block       = other.m_virtual_block;
+        m_capacity            = other.m_capacity;
+        m_max                 = other.m_max;
+        m_live_allocations    = std::move(other.m_live_allocations);
         other.m_virtual_block = nullptr;
         return *this;
     }
 
+private:
+    struct LiveAllocation {
+        VmaVirtualAllocation allocation = nullptr;
+        u32 size                        = 0;
+        u32 alignment                   = 1;
+    };
+
+    // clears the block and allocates the layout at its offsets, returns false if vma places anything elsewhere
+    bool _rebuild(std::vector<std::pair<u32, LiveAllocation>>& layout);
+
 private:
     VmaVirtualBlock m_virtual_block = nullptr;
     u32 m_capacity = 0, m_max = 0;
+
+    // keyed by offset
+    DenseHashMap<u32, LiveAllocation> m_live_allocations;
 };
 
-}; // namespace vke
\ No newline at end of file
+}; // namespace vke
@@ -200,6 +200,15 @@ void VulkanContext::query_device_info() {
     dt().vkGetPhysicalDeviceProperties(m_physical_device, &m_device_info->properties);
     dt().vkGetPhysicalDeviceMemoryProperties(m_physical_device, &m_device_info->memory_properties);
 
+    auto& memory_properties = m_device_info->memory_properties;
+    for (u32 i = 0; i < memory_properties.memoryTypeCount; i++) {
+        auto flags = memory_properties.memoryTypes[i].propertyFlags;
+        if ((flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) == 0 || (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) == 0) continue;
+
+        auto heap_size = memory_properties.memoryHeaps[memory_properties.memoryTypes[i].heapIndex].size;
+        m_device_info->host_visible_device_local_heap_size = std::max(m_device_info->host_visible_device_local_heap_size, heap_size);
+    }
+
     VkPhysicalDeviceFeatures2 features2{
         .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
         .pNext = &m_device_info->features1_1,
@@ -15,6 +15,9 @@ namespace vke {
 struct DeviceInfo {
     VkPhysicalDeviceProperties properties;
     VkPhysicalDeviceMemoryProperties memory_properties;
+    // size of the largest heap with a DEVICE_LOCAL | HOST_VISIBLE memory type, 0 if there is none.
+    // a few hundred MiB on discrete gpus without resizable bar, the whole vram with it and on integrated gpus
+    VkDeviceSize host_visible_device_local_heap_size = 0;
 
     VkPhysicalDeviceFeatures features            = {};
     VkPhysicalDeviceVulkan11Features features1_1 = {};